@@ -0,0 +1,374 @@
+#include "checks.h"
+#include "clothSim.h"
+#include "model.h"
+#include "implicitSolver.h"
+#include "projectiveSolver.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <functional>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+using namespace std;
+
+//A cloth some steps into its fall onto the sphere, so the springs are stretched and it moves
+static Cloth* movingCloth(int n, int steps){
+    Cloth* cloth = new Cloth(n);
+    initializeCloth(*cloth, clothSize/(n-1));
+    SimParams params;
+    for (int s = 0; s < steps; s++) step(*cloth, params, 1.0f/60.0f);
+    return cloth;
+}
+
+//Largest difference between the first count entries of a and b, relative to the largest entry of a
+static float relativeDifference(const Vec3Array& a, const Vec3Array& b, int count){
+    float largest = 0.0f, difference = 0.0f;
+    for (int k = 0; k < count; k++){
+        glm::vec3 d = a.get(k) - b.get(k);
+        largest = max(largest, dot(a.get(k),a.get(k)));
+        //written so a NaN also counts as the largest difference
+        if (!(dot(d,d) <= difference)) difference = dot(d,d);
+    }
+    return largest > 0.0f ? sqrt(difference/largest) : sqrt(difference);
+}
+
+static bool report(const char* name, bool passed, const string& detail){
+    printf("check %-28s %s  %s\n", name, passed ? "ok    " : "FAILED", detail.c_str());
+    return passed;
+}
+
+//Every pass of the vector kernels against the scalar ones from the same state, over a grid whose
+//rows are not a multiple of the vector width. Rounding (and FMA) differs, so they agree to a
+//tolerance rather than bit for bit.
+static bool checkKernels(){
+    const int n = 37;
+    const float tolerance = 1e-4f;
+    Cloth* start = movingCloth(n, 40);
+    SpringKernels saved = springKernels;
+    const char* names[3] = {"scalar", "sse", "avx2"};
+    Cloth* results[3] = {NULL, NULL, NULL};
+    for (int s = 0; s < 3; s++){
+        selectSpringKernels(names[s]);
+        if (strcmp(springKernels.name, names[s]) != 0) continue;
+        Cloth* cloth = results[s] = new Cloth(n);
+        cloth->l0 = start->l0;
+        cloth->pos.copy(start->pos, n*n);
+        cloth->vel.copy(start->vel, n*n);
+        //impulses only, so the comparison is not swamped by the velocity the cloth already has
+        for (int k = 0; k < n*n; k++) cloth->vel.set(k, glm::vec3(0,0,0));
+        SimParams params;
+        float dt = 1.0f/60.0f;
+        for (int i = 0; i < n-1; i++) springKernels.vertical(*cloth, i, params.ks*dt, params.kd*dt);
+        for (int i = 0; i < n; i++) springKernels.horizontal(*cloth, i, params.ks*dt, params.kd*dt);
+        for (int i = 0; i < n-1; i++) springKernels.aero(*cloth, i, -params.aero*dt/32.0f, params.aero*dt/8.0f);
+        for (int i = 0; i < n; i++) springKernels.normals(*cloth, i);
+    }
+    springKernels = saved;
+    bool passed = true;
+    string detail;
+    for (int s = 1; s < 3; s++){
+        char line[160];
+        if (results[s] == NULL){
+            snprintf(line, sizeof(line), "%s: not supported here  ", names[s]);
+            detail += line;
+            continue;
+        }
+        float springs = relativeDifference(results[0]->vel, results[s]->vel, n*n);
+        float faces = max(relativeDifference(results[0]->faceNormal, results[s]->faceNormal, (n+1)*(n+1)),
+                          relativeDifference(results[0]->faceAero, results[s]->faceAero, (n+1)*(n+1)));
+        float normals = relativeDifference(results[0]->norm, results[s]->norm, n*n);
+        passed = passed && springs <= tolerance && faces <= tolerance && normals <= tolerance;
+        snprintf(line, sizeof(line), "%s: springs %.1e, faces %.1e, normals %.1e  ", names[s], springs, faces, normals);
+        detail += line;
+    }
+    for (int s = 0; s < 3; s++) delete results[s];
+    delete start;
+    return report("vector kernels", passed, detail);
+}
+
+//Whether the positions of a and b are equal bit for bit and finite
+static bool samePositions(const Cloth& a, const Cloth& b){
+    int count = a.n*a.n;
+    for (int k = 0; k < count; k++){
+        if (!isfinite(a.pos.x[k] + a.pos.y[k] + a.pos.z[k])) return false;
+    }
+    return memcmp(a.pos.x, b.pos.x, count*sizeof(float)) == 0 && memcmp(a.pos.y, b.pos.y, count*sizeof(float)) == 0 &&
+           memcmp(a.pos.z, b.pos.z, count*sizeof(float)) == 0;
+}
+
+//The same steps on one thread and on a pool, the row colorings and ordered sums make them equal
+//bit for bit for every integrator, with sleeping, with self collision and for an ensemble
+static bool checkThreads(){
+    const int n = 24, steps = 240;
+    const float dt = 1.0f/240.0f;
+    ThreadPool* saved = threadPool;
+    ThreadPool pool(4);
+    const char* names[8] = {"euler", "midpoint", "implicit", "xpbd", "projective", "sleep", "self", "ensemble"};
+    bool passed = true;
+    string failed;
+    for (int s = 0; s < 8; s++){
+        SimParams params;
+        if (s < 5) parseIntegrator(names[s], params.integrator);
+        if (s == 5) params.sleepEnergy = 0.05f;
+        if (s == 6) params.selfThickness = 0.02f;
+        bool same = true;
+        if (s < 7){
+            Cloth* runs[2];
+            for (int r = 0; r < 2; r++){
+                threadPool = r == 0 ? NULL : &pool;
+                runs[r] = new Cloth(n);
+                initializeCloth(*runs[r], clothSize/(n-1));
+                for (int t = 0; t < steps; t++) step(*runs[r], params, dt);
+            }
+            same = samePositions(*runs[0], *runs[1]);
+            delete runs[0];
+            delete runs[1];
+        }
+        else{
+            //instances on the pool against the instances one after the other
+            Ensemble* runs[2];
+            for (int r = 0; r < 2; r++){
+                threadPool = r == 0 ? NULL : &pool;
+                runs[r] = new Ensemble(3, n);
+                for (int m = 0; m < 3; m++) runs[r]->params[m].wind = 0.5f*m;
+                for (int t = 0; t < steps; t++) runs[r]->step(dt);
+            }
+            for (int m = 0; m < 3; m++) same = same && samePositions(*runs[0]->cloths[m], *runs[1]->cloths[m]);
+            delete runs[0];
+            delete runs[1];
+        }
+        if (!same) failed += string(" ") + names[s];
+        passed = passed && same;
+    }
+    threadPool = saved;
+    return report("1 and 4 threads", passed, passed ? "euler, midpoint, implicit, xpbd, projective, sleep, self collision, ensemble" :
+                                                      "differ or diverge:" + failed);
+}
+
+static bool writeFile(const string& path, const string& contents){
+    FILE* file = fopen(path.c_str(), "wb");
+    if (file == NULL) return false;
+    bool written = fwrite(contents.data(), 1, contents.size(), file) == contents.size();
+    return fclose(file) == 0 && written;
+}
+
+//Overwrite bytes at offset, from the end of the file when offset is negative
+static bool patchFile(const string& path, long offset, const void* bytes, size_t size){
+    FILE* file = fopen(path.c_str(), "r+b");
+    if (file == NULL) return false;
+    bool written = fseek(file, offset, offset < 0 ? SEEK_END : SEEK_SET) == 0 && fwrite(bytes, 1, size, file) == size;
+    return fclose(file) == 0 && written;
+}
+
+//Run load with stdout discarded, for inputs that are meant to be rejected with an error message
+static bool quietly(const function<bool()>& load){
+    fflush(stdout);
+    int saved = dup(1), discard = open("/dev/null", O_WRONLY);
+    if (saved >= 0 && discard >= 0) dup2(discard, 1);
+    bool loaded = load();
+    fflush(stdout);
+    if (saved >= 0 && discard >= 0) dup2(saved, 1);
+    if (saved >= 0) close(saved);
+    if (discard >= 0) close(discard);
+    return loaded;
+}
+
+static bool sameMesh(const Model& a, const Model& b){
+    return a.count == b.count && a.indexCount == b.indexCount && a.checksum == b.checksum &&
+           memcmp(a.floats, b.floats, a.count*sizeof(float)) == 0 &&
+           memcmp(a.indices, b.indices, a.indexCount*sizeof(unsigned)) == 0;
+}
+
+//A unit quad as a text soup, two triangles of 8 floats per corner, 6 corners on 4 vertices
+static string quadSoup(){
+    const float corners[6][8] = {{0,0,0, 0,0, 0,0,1}, {1,0,0, 1,0, 0,0,1}, {1,1,0, 1,1, 0,0,1},
+                                 {0,0,0, 0,0, 0,0,1}, {1,1,0, 1,1, 0,0,1}, {0,1,0, 0,1, 0,0,1}};
+    string soup = "48\n";
+    for (int c = 0; c < 6; c++){
+        for (int k = 0; k < 8; k++){
+            char value[32];
+            snprintf(value, sizeof(value), "%g ", corners[c][k]);
+            soup += value;
+        }
+        soup += "\n";
+    }
+    return soup;
+}
+
+//A parse writes the binary cache and the next load maps it with the same mesh. A cache that is
+//cut off, has an index out of range, a wrong magic or changed data, or whose source changed, is
+//parsed again.
+static bool checkModelCache(const string& directory){
+    string path = directory + "/quad.txt", cachePath = path + ".bin";
+    if (!writeFile(path, quadSoup())) return report("model cache", false, "could not write " + path);
+    Model parsed;
+    bool passed = loadModel(path.c_str(), parsed) && !parsed.fromCache && parsed.vertexCount() == 4 && parsed.triangleCount() == 2;
+    string detail = passed ? "parsed 4 vertices" : "parse";
+    {
+        Model mapped;
+        bool ok = loadModel(path.c_str(), mapped) && mapped.fromCache && sameMesh(parsed, mapped);
+        detail += ok ? ", mapped back" : ", FAILED to map back";
+        passed = passed && ok;
+    }
+    //each corruption is applied to a freshly written cache, a rejected one is parsed again
+    const char* names[5] = {"cut off", "bad index", "bad magic", "source changed", "flipped float"};
+    for (int c = 0; c < 5; c++){
+        unsigned badIndex = 4;
+        float flipped = -1.0f;
+        bool patched = true;
+        //the cache is a 32 byte header, the floats and the indices
+        if (c == 0) patched = truncate(cachePath.c_str(), 32 + parsed.count*sizeof(float) + parsed.indexCount*sizeof(unsigned) - 4) == 0;
+        if (c == 1) patched = patchFile(cachePath, -(long)sizeof(unsigned), &badIndex, sizeof(badIndex));
+        if (c == 2) patched = patchFile(cachePath, 0, "MDL0", 4);
+        if (c == 3) patched = writeFile(path, quadSoup() + "\n");
+        //the first vertex's normal z, same size and structure with different data
+        if (c == 4) patched = patchFile(cachePath, 32 + 7*sizeof(float), &flipped, sizeof(flipped));
+        Model reloaded;
+        bool ok = patched && loadModel(path.c_str(), reloaded) && !reloaded.fromCache && sameMesh(parsed, reloaded);
+        detail += string(", ") + names[c] + (ok ? " reparsed" : " FAILED");
+        passed = passed && ok;
+    }
+    remove(cachePath.c_str());
+    remove(path.c_str());
+    return report("model cache", passed, detail);
+}
+
+//Binary little endian PLY of the unit quad's 4 vertices and one face, countType is the list count
+//type and listCount the count written for the face
+static string quadPly(const char* countType, unsigned char listCount){
+    string ply = string("ply\nformat binary_little_endian 1.0\nelement vertex 4\nproperty float x\nproperty float y\n"
+                        "property float z\nelement face 1\nproperty list ") + countType + " int vertex_indices\nend_header\n";
+    const float positions[4][3] = {{0,0,0}, {1,0,0}, {1,1,0}, {0,1,0}};
+    ply.append((const char*)positions, sizeof(positions));
+    ply += (char)listCount;
+    if (string(countType) == "int") ply.append(3, '\0');
+    const int face[4] = {0, 1, 2, 3};
+    ply.append((const char*)face, sizeof(face));
+    return ply;
+}
+
+//OBJ and PLY inputs that load into the welded quad, and malformed ones that are rejected
+static bool checkModelParsers(const string& directory){
+    string path = directory + "/quad";
+    struct Case{
+        const char* name;
+        const char* extension;
+        string contents;
+        //vertices and triangles expected, -1 when the load has to fail
+        int vertices, triangles;
+    };
+    string ply = quadPly("uchar", 4);
+    Case cases[] = {
+        {"obj", ".obj", "v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\nvt 0 0\nvt 1 0\nvt 1 1\nvt 0 1\nvn 0 0 1\n"
+                        "f 1/1/1 2/2/1 3/3/1 4/4/1\n", 4, 2},
+        {"obj negative", ".obj", "v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\nf -4 -3 -2\nf -4 -2 -1\n", 4, 2},
+        {"obj duplicates", ".obj", "v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 0 0\nv 1 1 0\nv 0 1 0\nvn 0 0 1\n"
+                                   "f 1//1 2//1 3//1\nf 4//1 5//1 6//1\n", 4, 2},
+        {"obj bad index", ".obj", "v 0 0 0\nv 1 0 0\nv 1 1 0\nf 1 2 9\n", -1, -1},
+        {"ply", ".ply", ply, 4, 2},
+        {"ply int count", ".ply", quadPly("int", 4), 4, 2},
+        {"ply long list", ".ply", quadPly("uchar", 200), -1, -1},
+        {"ply truncated", ".ply", ply.substr(0, ply.size() - 6), -1, -1},
+        {"ply ascii", ".ply", "ply\nformat ascii 1.0\nelement vertex 3\nproperty float x\nproperty float y\n"
+                              "property float z\nend_header\n0 0 0\n1 0 0\n1 1 0\n", -1, -1},
+    };
+    bool passed = true;
+    string failed;
+    int count = sizeof(cases)/sizeof(cases[0]);
+    for (int c = 0; c < count; c++){
+        string file = path + cases[c].extension;
+        Model model;
+        bool written = writeFile(file, cases[c].contents);
+        bool obj = string(cases[c].extension) == ".obj";
+        bool loaded = quietly([&](){ return obj ? loadModelObj(file.c_str(), model) : loadModelPly(file.c_str(), model); });
+        bool ok = written && (cases[c].vertices < 0 ? !loaded :
+                  loaded && model.vertexCount() == cases[c].vertices && model.triangleCount() == cases[c].triangles);
+        if (!ok) failed += string(", ") + cases[c].name;
+        passed = passed && ok;
+        remove(file.c_str());
+    }
+    char detail[64];
+    snprintf(detail, sizeof(detail), "%d OBJ and PLY files, 4 of them malformed", count);
+    return report("model parsers", passed, passed ? detail : "wrong result for" + failed.substr(1));
+}
+
+//Implicit steps of a stiff cloth: the velocity change CG returns has to solve the system to its
+//tolerance, measured with the matrix rather than the residual CG updates as it goes
+static bool checkConjugateGradient(){
+    const int n = 30, steps = 20;
+    const float dt = 1.0f/60.0f;
+    Cloth* cloth = movingCloth(n, 40);
+    SimParams params;
+    params.integrator = IMPLICIT;
+    params.ks = 90000.0f;
+    params.cgIterations = 1000;
+    params.cgTolerance = 1e-4f;
+    ImplicitSolver solver(n);
+    double worst = 0.0;
+    int most = 0;
+    for (int s = 0; s < steps; s++){
+        most = max(most, solver.solve(*cloth, params, dt));
+        double residual = solver.residual(*cloth, params);
+        if (!(residual <= worst)) worst = residual;
+        integratePositions(*cloth, params, dt);
+    }
+    delete cloth;
+    //float rounding lets the true residual drift a little past the recurrence's
+    bool passed = most < params.cgIterations && worst <= 2.0*params.cgTolerance;
+    char detail[96];
+    snprintf(detail, sizeof(detail), "relative residual at most %.2e for tolerance %g, at most %d iterations",
+             worst, params.cgTolerance, most);
+    return report("conjugate gradient", passed, detail);
+}
+
+//Projective dynamics refactors when ks or the pinning change. The cloth has to come out the same
+//as with a solver built fresh at each change, which factors from a clean workspace.
+static bool checkProjectiveRefactor(){
+    const int n = 20, steps = 60;
+    const float dt = 1.0f/60.0f;
+    Cloth* runs[2];
+    for (int r = 0; r < 2; r++){
+        runs[r] = new Cloth(n);
+        initializeCloth(*runs[r], clothSize/(n-1));
+        SimParams params;
+        params.integrator = PROJECTIVE;
+        for (int phase = 0; phase < 3; phase++){
+            if (phase == 1) params.ks *= 2.0f;
+            if (phase == 2) params.drop = true;
+            if (r == 1){
+                delete runs[r]->projectiveSolver;
+                runs[r]->projectiveSolver = NULL;
+            }
+            for (int s = 0; s < steps; s++) step(*runs[r], params, dt);
+        }
+    }
+    bool passed = samePositions(*runs[0], *runs[1]) && runs[0]->projectiveSolver->factorizations == 3;
+    delete runs[0];
+    delete runs[1];
+    return report("projective refactor", passed, "ks doubled, then dropped, against fresh solvers");
+}
+
+bool runChecks(){
+    selectSpringKernels(NULL);
+    bool passed = true;
+    passed = checkKernels() && passed;
+    passed = checkThreads() && passed;
+    passed = checkConjugateGradient() && passed;
+    passed = checkProjectiveRefactor() && passed;
+    //model files are written to a scratch directory
+    char directory[] = "/tmp/clothChecksXXXXXX";
+    if (mkdtemp(directory) == NULL){
+        passed = report("model files", false, "could not create a scratch directory");
+    }
+    else{
+        passed = checkModelCache(directory) && passed;
+        passed = checkModelParsers(directory) && passed;
+        rmdir(directory);
+    }
+    printf(passed ? "all checks passed\n" : "some checks FAILED\n");
+    return passed;
+}
@@ -0,0 +1,8 @@
+#ifndef CHECKS_H
+#define CHECKS_H
+
+//Self checks of the simulation code, run by clothHeadless -check. Each check prints one line,
+//returns whether all of them passed.
+bool runChecks();
+
+#endif
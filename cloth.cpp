@@ -1,16 +1,23 @@
+//SDL/OpenGL cloth viewer. Build together with the simulation sources:
+//  cloth.cpp clothSim.cpp implicitSolver.cpp xpbdSolver.cpp projectiveSolver.cpp
+//  collision.cpp selfCollision.cpp model.cpp springKernels.cpp threadPool.cpp (-pthread, SDL2, GLEW, OpenGL)
+
 #include <GL/glew.h>   //Include order can matter here
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_opengl.h>
 
-#define GLM_FORCE_RADIANS
-#include "glm/glm.hpp"
+#include "clothSim.h"
+#include "collision.h"
+#include "model.h"
 #include "glm/gtc/matrix_transform.hpp"
 #include "glm/gtc/type_ptr.hpp"
 
 #include <cstdio>
+#include <cstdlib>
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <vector>
 using namespace std;
 
 
@@ -18,55 +25,38 @@ using namespace std;
 float timePast = 0;
 float objx=0, objy=0.f, objz=0.0f;
 bool DEBUG_ON = false;
-bool MIDPOINT = false;
 bool fullscreen = false;
-const int N = 15;
-const float clothHeight = 1.0f;
-const float gravity = -0.05;
-//float ks = 1500;
-//const float kd = 20.f;
-float ks = 35;
-const float kd = 0.5f;
-const float l0 = 0.13f;
-bool drop = false;
-float wind = 0.0f;
-glm::vec3 sphereCenter = glm::vec3(0,0,0);
+SimParams params;
 
-//Functions
-GLuint InitShader(const char* vShaderFileName, const char* fShaderFileName);
-void initializeCloth(float spacing);
-void flattenClothMatrix(float*);
-void update(float dt);
-void midpointUpdate(float dt);
-float dot(glm::vec3 v1, glm::vec3 v2);
-glm::vec3 cross(glm::vec3 a, glm::vec3 b);
-glm::vec3 normalize(glm::vec3);
-
-//CLASS
-class Point{
+//Attribute and uniform locations of the shader program, looked up once after it is linked
+class ProgramLocations{
 public:
-    Point();
-    Point(glm::vec3, glm::vec2);
-    glm::vec3 pos;
-    glm::vec3 norm;
-    glm::vec2 texCoord;
-    glm::vec3 vel;
-    glm::vec3 futureVel;
-    glm::vec3 futurePos;
+    ProgramLocations(GLuint program);
+    GLint position, normal, texcoord;
+    GLint model, view, proj;
 };
 
-Point::Point(){}
+//Model uploaded once into its own VAO with its vertex and index buffers, so drawing it is a bind
+//and a draw call
+class StaticMesh{
+public:
+    StaticMesh(const Model& model, const ProgramLocations& locations);
+    ~StaticMesh();
+    void bind() const;
+    //Draw with the VAO already bound
+    void drawBound() const;
+    void draw() const;
+    GLuint vao, vbo, ebo;
+    int indexCount;
+};
 
-Point::Point(glm::vec3 _pos, glm::vec2 _texCoord){
-    pos = _pos;
-    norm = glm::vec3(0.f,1.f,0.f);
-    texCoord = _texCoord;
-    vel = glm::vec3(0.0f,0.0f,0.0f);
-    futureVel = glm::vec3(0.0f,0.0f,0.0f);
-    futurePos = _pos;
-}
+//Functions
+GLuint InitShader(const char* vShaderFileName, const char* fShaderFileName);
+void flattenClothMatrix(Cloth& cloth, float*);
+void buildClothIndices(int N, GLuint* indices);
+void drawScene(const ProgramLocations& locations, const vector<Collider*>& scene, const StaticMesh* sphereMesh, const StaticMesh* cubeMesh);
 
-Point cloth[N][N];
+//CLASS
 
 class Camera{
 public:
@@ -87,6 +77,28 @@ private:
     void updateRot();
 };
 
+//Ring of regions in one vertex buffer for the cloth, the packing code writes the next region
+//through a mapped pointer while the GPU may still draw from the others. A fence per region
+//means a frame only waits when it catches up with one the GPU has not finished reading.
+#define STREAM_REGIONS 3
+class ClothStream{
+public:
+    ClothStream(GLuint buffer, int regionFloats);
+    ~ClothStream();
+    //Wait for the current region to be free and map it, the buffer must be bound to GL_ARRAY_BUFFER
+    float* map();
+    //Unmap (unless persistent), returns the byte offset of the region just written
+    GLintptr unmap();
+    //Fence the region after the draws that read it and move to the next one
+    void fence();
+    GLuint buffer;
+    int regionFloats;
+    int region;
+    //The whole ring, mapped once when ARB_buffer_storage is supported
+    float* persistent;
+    GLsync fences[STREAM_REGIONS];
+};
+
 Camera::Camera(){
     pos = glm::vec3(2.f, 0.5f, 4.f);
     look = glm::vec3(0.0f, 0.0f, 0.0f);
@@ -153,12 +165,88 @@ Camera camera;
 
 int main(int argc, char *argv[]){
     
+    //COMMAND LINE
+    int N = 15;
+    const char* kernelName = NULL;
+    int numThreads = 1;
+    SimClock simClock(1.0f/60.0f, 8);
+    float adaptiveTolerance = 0.0f;
+    const char* obstacleName = NULL;
+    float sdfCell = 0.0f;
+    const char* sceneName = NULL;
+    for (int i = 1; i < argc; i++){
+        if (string(argv[i]) == "-n" && i+1 < argc){
+            N = atoi(argv[++i]);
+        }
+        else if (string(argv[i]) == "-kernel" && i+1 < argc){
+            kernelName = argv[++i];
+        }
+        else if (string(argv[i]) == "-threads" && i+1 < argc){
+            numThreads = atoi(argv[++i]);
+        }
+        else if (string(argv[i]) == "-dt" && i+1 < argc){
+            simClock.fixedDt = atof(argv[++i]);
+        }
+        else if (string(argv[i]) == "-maxsubsteps" && i+1 < argc){
+            simClock.maxSubsteps = atoi(argv[++i]);
+        }
+        else if (string(argv[i]) == "-adaptive" && i+1 < argc){
+            adaptiveTolerance = atof(argv[++i]);
+        }
+        else if (string(argv[i]) == "-obstacle" && i+1 < argc){
+            obstacleName = argv[++i];
+        }
+        else if (string(argv[i]) == "-sdf" && i+1 < argc){
+            sdfCell = atof(argv[++i]);
+        }
+        else if (string(argv[i]) == "-scene" && i+1 < argc){
+            sceneName = argv[++i];
+        }
+        else if (string(argv[i]) == "-ccd"){
+            params.ccd = true;
+        }
+        else if (string(argv[i]) == "-tiled"){
+            params.tiled = true;
+        }
+        else if (string(argv[i]) == "-self" && i+1 < argc){
+            params.selfThickness = atof(argv[++i]);
+        }
+        else if (string(argv[i]) == "-sleep" && i+1 < argc){
+            params.sleepEnergy = atof(argv[++i]);
+        }
+        else if (string(argv[i]) == "-integrator" && i+1 < argc){
+            if (!parseIntegrator(argv[++i], params.integrator)){
+                printf("Error: unknown integrator \"%s\"\n", argv[i]); return 1;
+            }
+        }
+    }
+    if (N < 2){
+        printf("Error: cloth size must be at least 2 (got %d)\n", N); return 1;
+    }
+    if (simClock.fixedDt <= 0.0f || simClock.maxSubsteps < 1){
+        printf("Error: -dt must be positive and -maxsubsteps at least 1\n"); return 1;
+    }
+    
+    if (params.tiled && params.sleepEnergy > 0.0f){
+        printf("Error: -tiled sweeps every row, it does not combine with -sleep\n"); return 1;
+    }
+    if (adaptiveTolerance > 0.0f && params.integrator != IMPLICIT){
+        printf("Error: -adaptive grows dt past the explicit stability limit, it needs -integrator implicit\n"); return 1;
+    }
+    
+    AdaptiveStepper stepper(adaptiveTolerance, simClock.fixedDt/64.0f, simClock.fixedDt*8.0f);
+    selectSpringKernels(kernelName);
+    printf("Spring kernel: %s\n", springKernels.name);
+    if (numThreads > 1){
+        threadPool = new ThreadPool(numThreads);
+    }
+    
     //INTITIALIZATION
     SDL_Init(SDL_INIT_VIDEO);  //Initialize Graphics (for OpenGL)
     //Ask SDL to get a recent version of OpenGL (3.2 or greater)
     SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
 	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
-	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 1);
+	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 2); //fences need 3.2
 	
 
 	
@@ -179,23 +267,50 @@ int main(int argc, char *argv[]){
 	glBindVertexArray(vao); //Bind the above created VAO to the current context
 	
     //INIT CLOTH MATRIX
-    initializeCloth(l0);
-    int clothDataSize = 48*(N-1)*(N-1);
-    float clothData[clothDataSize];
+    Cloth* cloth = new Cloth(N);
+    initializeCloth(*cloth, clothSize/(N-1));
+    //one 8 float vertex per particle, the triangles index into them
+    int clothDataSize = 8*N*N;
+    int clothIndexCount = 6*(N-1)*(N-1);
     
 	//MODELS
-    ifstream modelFile;
-    modelFile.open("models/sphere.txt");
-    int numLines = 0;
-    modelFile >> numLines;
-    float* modelData = new float[numLines];
-    for (int i = 0; i < numLines; i++){
-        modelFile >> modelData[i];
+    //the obstacle model replaces the sphere for both drawing and collision, and moves with the same keys
+    Model model;
+    if (!loadModel(obstacleName != NULL ? obstacleName : "models/sphere.txt", model)){
+        return 1;
+    }
+    Collider* obstacle = NULL;
+    if (obstacleName != NULL && sdfCell > 0.0f){
+        //static obstacles can use a distance field instead, cached next to the model
+        string cachePath = string(obstacleName) + ".sdf";
+        SdfCollider* sdf = loadSdfCollider(model, .05f, sdfCell, cachePath.c_str());
+        if (sdf == NULL){
+            printf("Error: model %s has no triangles\n", obstacleName); return 1;
+        }
+        printf("Obstacle: %s, %dx%dx%d distance field %s %s\n", obstacleName, sdf->dims[0], sdf->dims[1], sdf->dims[2],
+               sdf->fromCache ? "loaded from" : "built and cached in", cachePath.c_str());
+        obstacle = sdf;
+    }
+    else if (obstacleName != NULL){
+        MeshCollider* mesh = new MeshCollider(model, .05f);
+        printf("Obstacle: %s, %d triangles\n", obstacleName, mesh->triangleCount());
+        obstacle = mesh;
+    }
+    if (obstacle != NULL){
+        params.sphere = false;
+        params.colliders.push_back(obstacle);
+    }
+    //scene obstacles stay where the file puts them, drawn with the sphere and cube models
+    vector<Collider*> scene;
+    Model sphereModel, cubeModel;
+    if (sceneName != NULL){
+        if (!loadScene(sceneName, .02f, scene) || !loadModel("models/sphere.txt", sphereModel) || !loadModel("models/cube.txt", cubeModel)){
+            return 1;
+        }
+        printf("Scene: %s, %d obstacles\n", sceneName, (int)scene.size());
+        params.sphere = false;
+        params.colliders.insert(params.colliders.end(), scene.begin(), scene.end());
     }
-    int numTris = numLines/8;
-    modelFile.close();
-    
-    int totalNumTris = numTris;
     
     //TEXTURES
     SDL_Surface* surface = SDL_LoadBMP("red.bmp");
@@ -242,14 +357,43 @@ int main(int argc, char *argv[]){
     
 	
 	
-	//Allocate memory on the graphics card to store geometry (vertex buffer object)
-	GLuint vbo[2];
-	glGenBuffers(2, vbo);  //Create 1 buffer called vbo
-	glBindBuffer(GL_ARRAY_BUFFER, vbo[0]);
-    
 	int shaderProgram = InitShader("vertexTex.glsl", "fragmentTex.glsl");
 	glUseProgram(shaderProgram); //Set the active shader (only one can be used at a time)
 	glEnable(GL_DEPTH_TEST);
+    ProgramLocations locations(shaderProgram);
+	
+	//Allocate memory on the graphics card to store geometry (vertex buffer object)
+    //The cloth streams its vertices through a ring in clothVbo, the VAO bound above keeps its
+    //attribute pointers and index buffer
+	GLuint clothVbo;
+	glGenBuffers(1, &clothVbo);
+    ClothStream* clothStream = new ClothStream(clothVbo, clothDataSize);
+	glVertexAttribPointer(locations.position, 3, GL_FLOAT, GL_FALSE, 8*sizeof(float), 0);
+	  //Attribute, vals/attrib., type, normalized?, stride, offset
+	  //Binds to VBO current GL_ARRAY_BUFFER 
+	glEnableVertexAttribArray(locations.position);
+	glVertexAttribPointer(locations.normal, 3, GL_FLOAT, GL_FALSE, 8*sizeof(float), (void*)(3*sizeof(float)));
+	glEnableVertexAttribArray(locations.normal);
+	glVertexAttribPointer(locations.texcoord, 2, GL_FLOAT, GL_FALSE, 8*sizeof(float), (void*)(6*sizeof(float)));
+	glEnableVertexAttribArray(locations.texcoord);
+    
+    //The grid never changes so the cloth's index buffer is filled once, the VAO keeps it bound
+    GLuint ebo;
+    glGenBuffers(1, &ebo);
+    GLuint* clothIndices = new GLuint[clothIndexCount];
+    buildClothIndices(N, clothIndices);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, clothIndexCount*sizeof(GLuint), clothIndices, GL_STATIC_DRAW);
+    delete[] clothIndices;
+    
+    //Obstacle models never change, each is uploaded once into its own VAO
+    StaticMesh* obstacleMesh = new StaticMesh(model, locations);
+    StaticMesh* sphereMesh = NULL;
+    StaticMesh* cubeMesh = NULL;
+    if (!scene.empty()){
+        sphereMesh = new StaticMesh(sphereModel, locations);
+        cubeMesh = new StaticMesh(cubeModel, locations);
+    }
     
     float newTime, frameTime = 0.0f;
 	
@@ -267,31 +411,31 @@ int main(int argc, char *argv[]){
           //SDL_SetWindowFullscreen(window, fullscreen ? SDL_WINDOW_FULLSCREEN : 0); //Toggle fullscreen
         }
         if (windowEvent.type == SDL_KEYUP && windowEvent.key.keysym.sym == SDLK_SPACE){ //If "f" is pressed
-            drop = true;
+            params.drop = true;
         }
         if (windowEvent.type == SDL_KEYUP && windowEvent.key.keysym.sym == SDLK_LEFT){ //If "f" is pressed
-            wind -= .5;
+            params.wind -= .5;
         }
         if (windowEvent.type == SDL_KEYUP && windowEvent.key.keysym.sym == SDLK_RIGHT){ //If "f" is pressed
-            wind += .5;
+            params.wind += .5;
         }
         if (windowEvent.type == SDL_KEYUP && windowEvent.key.keysym.sym == SDLK_UP){ //If "f" is pressed
-            ks += .5;
+            params.ks += 30;
         }
         if (windowEvent.type == SDL_KEYUP && windowEvent.key.keysym.sym == SDLK_DOWN){ //If "f" is pressed
-            ks -= .5;
+            params.ks -= 30;
         }
         if (windowEvent.type == SDL_KEYDOWN && windowEvent.key.keysym.sym == SDLK_i){ //If "f" is pressed
-            sphereCenter[2] -= 7*frameTime;
+            params.sphereCenter[2] -= 7*frameTime;
         }
         if (windowEvent.type == SDL_KEYDOWN && windowEvent.key.keysym.sym == SDLK_j){ //If "f" is pressed
-            sphereCenter[0] -= 7*frameTime;
+            params.sphereCenter[0] -= 7*frameTime;
         }
         if (windowEvent.type == SDL_KEYDOWN && windowEvent.key.keysym.sym == SDLK_k){ //If "f" is pressed
-            sphereCenter[2] += 7*frameTime;
+            params.sphereCenter[2] += 7*frameTime;
         }
         if (windowEvent.type == SDL_KEYDOWN && windowEvent.key.keysym.sym == SDLK_l){ //If "f" is pressed
-            sphereCenter[0] += 7*frameTime;
+            params.sphereCenter[0] += 7*frameTime;
         }
           if (windowEvent.type == SDL_KEYDOWN && windowEvent.key.keysym.sym == SDLK_s){
               camera.backward = true;
@@ -378,45 +522,33 @@ int main(int argc, char *argv[]){
      glUseProgram(shaderProgram);
         
      //frameTime = .005;
-     if (MIDPOINT){
-        midpointUpdate(frameTime);
+     if (obstacle != NULL){
+        obstacle->position = params.sphereCenter;
+     }
+     if (adaptiveTolerance > 0.0f){
+        //error controlled steps drain the accumulator, still at most maxSubsteps per frame
+        simClock.accumulator += frameTime;
+        int substeps = 0;
+        while (simClock.accumulator >= stepper.dt && substeps < simClock.maxSubsteps){
+           simClock.accumulator -= stepper.advance(*cloth, params, simClock.accumulator);
+           substeps++;
+        }
+        if (substeps == simClock.maxSubsteps) simClock.accumulator = 0.0f;
      }
      else{
-      update(frameTime);
+        int substeps = simClock.advance(frameTime);
+        for (int s = 0; s < substeps; s++){
+           step(*cloth, params, simClock.fixedDt);
+        }
      }
-     flattenClothMatrix(clothData);
-
+     //the steps leave the normals alone, only the drawn state needs them
+     computeNormals(*cloth);
      
      //BIND BUFFERS AND DEFINE DATA
-     glBindBuffer(GL_ARRAY_BUFFER, vbo[0]);
-     glBufferData(GL_ARRAY_BUFFER, clothDataSize*sizeof(float), clothData, GL_STATIC_DRAW);
-     
-     //Tell OpenGL how to set fragment shader input 
-	GLint posAttrib = glGetAttribLocation(shaderProgram, "position");
-	glVertexAttribPointer(posAttrib, 3, GL_FLOAT, GL_FALSE, 8*sizeof(float), 0);
-	  //Attribute, vals/attrib., type, normalized?, stride, offset
-	  //Binds to VBO current GL_ARRAY_BUFFER 
-	glEnableVertexAttribArray(posAttrib);
-
-	//GLint colAttrib = glGetAttribLocation(shaderProgram, "inColor");
-	//glVertexAttribPointer(colAttrib, 3, GL_FLOAT, GL_FALSE, 8*sizeof(float), (void*)(3*sizeof(float)));
-	//glEnableVertexAttribArray(colAttrib);
-	
-	GLint normAttrib = glGetAttribLocation(shaderProgram, "inNormal");
-	glVertexAttribPointer(normAttrib, 3, GL_FLOAT, GL_FALSE, 8*sizeof(float), (void*)(3*sizeof(float)));
-	glEnableVertexAttribArray(normAttrib);
-	
-	GLint texAttrib = glGetAttribLocation(shaderProgram, "inTexcoord");
-	glEnableVertexAttribArray(texAttrib);
-	glVertexAttribPointer(texAttrib, 2, GL_FLOAT, GL_FALSE,
-                       8*sizeof(float), (void*)(6*sizeof(float)));
-
-      
-      
-      
-      GLint uniModel = glGetUniformLocation(shaderProgram, "model");
-      GLint uniView = glGetUniformLocation(shaderProgram, "view");
-      GLint uniProj = glGetUniformLocation(shaderProgram, "proj");
+     //pack straight into this frame's region of the ring, the draw picks it with a base vertex
+     glBindBuffer(GL_ARRAY_BUFFER, clothVbo);
+     flattenClothMatrix(*cloth, clothStream->map());
+     GLint clothBase = (GLint)(clothStream->unmap()/(8*sizeof(float)));
 
       glm::mat4 view = glm::lookAt(camera.pos, camera.look, camera.up); //Up
         
@@ -430,52 +562,48 @@ int main(int argc, char *argv[]){
 //      	glm::vec3(0.0f, 0.0f, 0.0f),  //Look at point
 //      	glm::vec3(0.0f, 1.0f, 0.0f)); //Up
       
-        glUniformMatrix4fv(uniView, 1, GL_FALSE, glm::value_ptr(view));
+        glUniformMatrix4fv(locations.view, 1, GL_FALSE, glm::value_ptr(view));
       
       
         glm::mat4 proj = glm::perspective(3.14f/4, 800.0f / 600.0f, 1.0f, 100.0f); //FOV, aspect, near, far
-        glUniformMatrix4fv(uniProj, 1, GL_FALSE, glm::value_ptr(proj));
+        glUniformMatrix4fv(locations.proj, 1, GL_FALSE, glm::value_ptr(proj));
       
       	glm::mat4 model;
-        glUniformMatrix4fv(uniModel, 1, GL_FALSE, glm::value_ptr(model));
+        glUniformMatrix4fv(locations.model, 1, GL_FALSE, glm::value_ptr(model));
       
         //DRAW CLOTH
+        glBindVertexArray(vao);
         glBindTexture(GL_TEXTURE_2D, tex);
         glPointSize(5);
-        glDrawArrays(GL_TRIANGLES, 0, clothDataSize/8); //(Primitives, Which VBO, Number of vertices)
-        
-        //DRAW SPHERE
-        model = glm::translate(model, sphereCenter);
-        glUniformMatrix4fv(uniModel, 1, GL_FALSE, glm::value_ptr(model));
-        glBindTexture(GL_TEXTURE_2D, wtex);
-        glBindBuffer(GL_ARRAY_BUFFER, vbo[1]);
-        glBufferData(GL_ARRAY_BUFFER, totalNumTris*8*sizeof(float), modelData, GL_STATIC_DRAW);
-        
-        //Tell OpenGL how to set fragment shader input
-        posAttrib = glGetAttribLocation(shaderProgram, "position");
-        glVertexAttribPointer(posAttrib, 3, GL_FLOAT, GL_FALSE, 8*sizeof(float), 0);
-        //Attribute, vals/attrib., type, normalized?, stride, offset
-        //Binds to VBO current GL_ARRAY_BUFFER
-        glEnableVertexAttribArray(posAttrib);
-        
-        normAttrib = glGetAttribLocation(shaderProgram, "inNormal");
-        glVertexAttribPointer(normAttrib, 3, GL_FLOAT, GL_FALSE, 8*sizeof(float), (void*)(5*sizeof(float)));
-        glEnableVertexAttribArray(normAttrib);
-        
-        texAttrib = glGetAttribLocation(shaderProgram, "inTexcoord");
-        glEnableVertexAttribArray(texAttrib);
-        glVertexAttribPointer(texAttrib, 2, GL_FLOAT, GL_FALSE,
-                              8*sizeof(float), (void*)(3*sizeof(float)));
+        glDrawElementsBaseVertex(GL_TRIANGLES, clothIndexCount, GL_UNSIGNED_INT, 0, clothBase); //(Primitives, Number of indices, Index type, Offset, First vertex)
+        clothStream->fence();
         
-        glDrawArrays(GL_TRIANGLES, 0, totalNumTris);
+        //DRAW SPHERE, or the obstacle model in its place, only when it collides
+        if (params.sphere || obstacle != NULL){
+            model = glm::translate(model, params.sphereCenter);
+            glUniformMatrix4fv(locations.model, 1, GL_FALSE, glm::value_ptr(model));
+            glBindTexture(GL_TEXTURE_2D, wtex);
+            obstacleMesh->draw();
+        }
         
+        //DRAW SCENE
+        drawScene(locations, scene, sphereMesh, cubeMesh);
       
         SDL_GL_SwapWindow(window); //Double buffering
 	}
 	
 	glDeleteProgram(shaderProgram);
-    glDeleteBuffers(1, vbo);
+    delete clothStream;
+    delete obstacleMesh;
+    delete sphereMesh;
+    delete cubeMesh;
+    glDeleteBuffers(1, &clothVbo);
+    glDeleteBuffers(1, &ebo);
     glDeleteVertexArrays(1, &vao);
+    delete cloth;
+    delete obstacle;
+    for (size_t i = 0; i < scene.size(); i++) delete scene[i];
+    delete threadPool;
 
 	//Clean Up
 	SDL_GL_DeleteContext(context);
@@ -483,372 +611,200 @@ int main(int argc, char *argv[]){
 	return 0;
 }
 
-void initializeCloth(float spacing){
-    
-    float clothWidth = spacing*(N-1);
-    float currX = -clothWidth/2.0;
-    float initZ = -clothWidth/2.0;
-    float currZ;
-    for (int i = 0; i < N; i++){
-        currZ = initZ;
-        for (int j = 0; j < N; j++){
-            glm::vec3 p = glm::vec3(currX,clothHeight,currZ);
-            glm::vec2 t = glm::vec2(j/(float)(N-1), i/(float)(N-1));
-            cloth[i][j] = Point(p,t);
-            currZ += spacing;
-        }
-        currX += spacing;
-    }
+ProgramLocations::ProgramLocations(GLuint program){
+    position = glGetAttribLocation(program, "position");
+    normal = glGetAttribLocation(program, "inNormal");
+    texcoord = glGetAttribLocation(program, "inTexcoord");
+    model = glGetUniformLocation(program, "model");
+    view = glGetUniformLocation(program, "view");
+    proj = glGetUniformLocation(program, "proj");
 }
 
-void printCloth(){
-        for (int i = 0; i < N; i++){
-            for (int j = 0; j < N; j++){
-                printf("(%.2g, %.2g, %.2g) ",cloth[i][j].vel[0],cloth[i][j].vel[1],cloth[i][j].vel[2]);
-            }
-            printf("\n");
+StaticMesh::StaticMesh(const Model& model, const ProgramLocations& locations){
+    indexCount = model.indexCount;
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+    glGenBuffers(1, &vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    //a cached model's vertices and indices go straight from the mapped file
+    glBufferData(GL_ARRAY_BUFFER, model.count*sizeof(float), model.floats, GL_STATIC_DRAW);
+    glGenBuffers(1, &ebo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, model.indexCount*sizeof(unsigned), model.indices, GL_STATIC_DRAW);
+    //model vertices are position, texcoord, normal
+    glVertexAttribPointer(locations.position, 3, GL_FLOAT, GL_FALSE, 8*sizeof(float), 0);
+    glEnableVertexAttribArray(locations.position);
+    glVertexAttribPointer(locations.texcoord, 2, GL_FLOAT, GL_FALSE, 8*sizeof(float), (void*)(3*sizeof(float)));
+    glEnableVertexAttribArray(locations.texcoord);
+    glVertexAttribPointer(locations.normal, 3, GL_FLOAT, GL_FALSE, 8*sizeof(float), (void*)(5*sizeof(float)));
+    glEnableVertexAttribArray(locations.normal);
+}
+
+StaticMesh::~StaticMesh(){
+    glDeleteBuffers(1, &vbo);
+    glDeleteBuffers(1, &ebo);
+    glDeleteVertexArrays(1, &vao);
+}
+
+void StaticMesh::bind() const{
+    glBindVertexArray(vao);
+}
+
+void StaticMesh::drawBound() const{
+    glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0);
+}
+
+void StaticMesh::draw() const{
+    glBindVertexArray(vao);
+    drawBound();
+}
+
+//Draw one model per obstacle: spheres and boxes scale the unit models, capsules are a row of
+//overlapping spheres along their segment
+void drawScene(const ProgramLocations& locations, const vector<Collider*>& scene, const StaticMesh* sphereMesh, const StaticMesh* cubeMesh){
+    const StaticMesh* bound = NULL;
+    for (size_t i = 0; i < scene.size(); i++){
+        const Collider* c = scene[i];
+        const BoxCollider* box = dynamic_cast<const BoxCollider*>(c);
+        const StaticMesh* mesh = box != NULL ? cubeMesh : sphereMesh;
+        if (mesh != bound){
+            mesh->bind();
+            bound = mesh;
+        }
+        glm::mat4 model;
+        if (box != NULL){
+            model = glm::scale(glm::translate(model, c->position), 2.0f*box->halfExtents);
+            glUniformMatrix4fv(locations.model, 1, GL_FALSE, glm::value_ptr(model));
+            mesh->drawBound();
+            continue;
+        }
+        //the sphere model has radius .5
+        const SphereCollider* sphere = dynamic_cast<const SphereCollider*>(c);
+        const CapsuleCollider* capsule = dynamic_cast<const CapsuleCollider*>(c);
+        glm::vec3 a = c->position, b = c->position;
+        float radius = 0.0f;
+        if (sphere != NULL) radius = sphere->radius;
+        else if (capsule != NULL){
+            a += capsule->a; b += capsule->b; radius = capsule->radius;
         }
-        printf("\n");
+        else continue;
+        int count = 1 + (int)(glm::length(b - a)/radius);
+        for (int k = 0; k <= count; k++){
+            glm::vec3 center = a + (b - a)*(float(k)/count);
+            model = glm::scale(glm::translate(glm::mat4(), center), glm::vec3(2.0f*radius));
+            glUniformMatrix4fv(locations.model, 1, GL_FALSE, glm::value_ptr(model));
+            mesh->drawBound();
+        }
+    }
 }
 
-void flattenClothMatrix2(float* clothData){
+void flattenClothMatrix2(Cloth& cloth, float* clothData){
     
-    for (int i = 0; i < N; i++){
-        for (int j = 0; j < N; j++){
-            int index = 3*(i*N+j);
-            clothData[index] = cloth[i][j].pos[0];
-            clothData[index+1] = cloth[i][j].pos[1];
-            clothData[index+2] = cloth[i][j].pos[2];
-        }
+    int N = cloth.n;
+    for (int k = 0; k < N*N; k++){
+        clothData[3*k] = cloth.pos.x[k];
+        clothData[3*k+1] = cloth.pos.y[k];
+        clothData[3*k+2] = cloth.pos.z[k];
     }
 //    for (int i = 0; i < 3*N*N; i+=3){
 //        printf("(%f %f %f)\n",clothData[i],clothData[i+1],clothData[i+2]);
 //    }
 }
 
-void flattenClothMatrix(float* clothData){
+//Write pos, norm and texCoord of particle k as one 8 float vertex
+static void flattenVertex(Cloth& cloth, int k, float* vertex){
+    vertex[0] = cloth.pos.x[k];
+    vertex[1] = cloth.pos.y[k];
+    vertex[2] = cloth.pos.z[k];
     
-    for (int i = 0; i < N-1; i++){
-        for (int j = 0; j < N-1; j++){
-            int index = 48*(i*(N-1)+j);
-            //TRIANGLE 1
-            //vert 1
-            clothData[index] = cloth[i][j].pos[0];
-            clothData[index+1] = cloth[i][j].pos[1];
-            clothData[index+2] = cloth[i][j].pos[2];
-            
-            clothData[index+3] = cloth[i][j].norm[0];
-            clothData[index+4] = cloth[i][j].norm[1];
-            clothData[index+5] = cloth[i][j].norm[2];
-            
-            clothData[index+6] = cloth[i][j].texCoord[0];
-            clothData[index+7] = cloth[i][j].texCoord[1];
-            
-            //vert 2
-            clothData[index+8] = cloth[i+1][j].pos[0];
-            clothData[index+9] = cloth[i+1][j].pos[1];
-            clothData[index+10] = cloth[i+1][j].pos[2];
-            
-            clothData[index+11] = cloth[i+1][j].norm[0];
-            clothData[index+12] = cloth[i+1][j].norm[1];
-            clothData[index+13] = cloth[i+1][j].norm[2];
-            
-            clothData[index+14] = cloth[i+1][j].texCoord[0];
-            clothData[index+15] = cloth[i+1][j].texCoord[1];
-            
-            //vert 3
-            clothData[index+16] = cloth[i][j+1].pos[0];
-            clothData[index+17] = cloth[i][j+1].pos[1];
-            clothData[index+18] = cloth[i][j+1].pos[2];
-            
-            clothData[index+19] = cloth[i][j+1].norm[0];
-            clothData[index+20] = cloth[i][j+1].norm[1];
-            clothData[index+21] = cloth[i][j+1].norm[2];
-            
-            clothData[index+22] = cloth[i][j+1].texCoord[0];
-            clothData[index+23] = cloth[i][j+1].texCoord[1];
-            
-            //TRIANGLE 2
-            //vert 1
-            clothData[index+24] = cloth[i+1][j].pos[0];
-            clothData[index+25] = cloth[i+1][j].pos[1];
-            clothData[index+26] = cloth[i+1][j].pos[2];
-            
-            clothData[index+27] = cloth[i+1][j].norm[0];
-            clothData[index+28] = cloth[i+1][j].norm[1];
-            clothData[index+29] = cloth[i+1][j].norm[2];
-            
-            clothData[index+30] = cloth[i+1][j].texCoord[0];
-            clothData[index+31] = cloth[i+1][j].texCoord[1];
-            
-            //vert 2
-            clothData[index+32] = cloth[i+1][j+1].pos[0];
-            clothData[index+33] = cloth[i+1][j+1].pos[1];
-            clothData[index+34] = cloth[i+1][j+1].pos[2];
-            
-            clothData[index+35] = cloth[i+1][j+1].norm[0];
-            clothData[index+36] = cloth[i+1][j+1].norm[1];
-            clothData[index+37] = cloth[i+1][j+1].norm[2];
-            
-            clothData[index+38] = cloth[i+1][j+1].texCoord[0];
-            clothData[index+39] = cloth[i+1][j+1].texCoord[1];
-            
-            //vert 3
-            clothData[index+40] = cloth[i][j+1].pos[0];
-            clothData[index+41] = cloth[i][j+1].pos[1];
-            clothData[index+42] = cloth[i][j+1].pos[2];
-            
-            clothData[index+43] = cloth[i][j+1].norm[0];
-            clothData[index+44] = cloth[i][j+1].norm[1];
-            clothData[index+45] = cloth[i][j+1].norm[2];
-            
-            clothData[index+46] = cloth[i][j+1].texCoord[0];
-            clothData[index+47] = cloth[i][j+1].texCoord[1];
-        }
-    }
-    //    for (int i = 0; i < 3*N*N; i+=3){
-    //        printf("(%f %f %f)\n",clothData[i],clothData[i+1],clothData[i+2]);
-    //    }
+    vertex[3] = cloth.norm.x[k];
+    vertex[4] = cloth.norm.y[k];
+    vertex[5] = cloth.norm.z[k];
+    
+    vertex[6] = cloth.texU[k];
+    vertex[7] = cloth.texV[k];
 }
 
-void update(float dt){
-    //printCloth();
-    //vertical
-    for (int i = 0; i < N-1; i++){
-        for (int j = 0; j < N; j++){
-            glm::vec3 e = cloth[i+1][j].pos - cloth[i][j].pos;
-            float l = sqrt(dot(e,e));
-            e = e * (1.0f/l);
-            float v1 = dot(e,cloth[i][j].vel);
-            float v2 = dot(e,cloth[i+1][j].vel);
-            float f = (-1.0f*ks*(l0-l))-(kd*(v1-v2));
-            cloth[i][j].vel += f*e;
-            cloth[i+1][j].vel -= f*e;
-        }
+ClothStream::ClothStream(GLuint buffer, int regionFloats) : buffer(buffer), regionFloats(regionFloats), region(0), persistent(NULL){
+    for (int r = 0; r < STREAM_REGIONS; r++) fences[r] = 0;
+    GLsizeiptr bytes = (GLsizeiptr)STREAM_REGIONS*regionFloats*sizeof(float);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    if (GLEW_ARB_buffer_storage){
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_ARRAY_BUFFER, bytes, NULL, flags);
+        persistent = (float*)glMapBufferRange(GL_ARRAY_BUFFER, 0, bytes, flags);
     }
-    //horizontal
-    for (int i = 0; i < N; i++){
-        for (int j = 0; j < N-1; j++){
-            glm::vec3 e = cloth[i][j+1].pos - cloth[i][j].pos;
-            float l = sqrt(dot(e,e));
-            e = e * (1.0f/l);
-            float v1 = dot(e,cloth[i][j].vel);
-            float v2 = dot(e,cloth[i][j+1].vel);
-            float f = (-1.0f*ks*(l0-l))-(kd*(v1-v2));
-            cloth[i][j].vel += f*e;
-            cloth[i][j+1].vel -= f*e;
-        }
-    }
-    //change pos
-    for (int i = 0; i < N; i++){
-        for (int j = 0; j < N; j++){
-            float distToOrigin = sqrt(dot(cloth[i][j].pos-sphereCenter,cloth[i][j].pos-sphereCenter));
-            if (cloth[i][j].pos[1] - (-2.0) < .02f){
-                continue;
-            }
-//            if (i == 0 && (j == 0 || j == N-1)){
-//                cloth[i][j].vel = glm::vec3(0,0,0);
-//            }
-            if (i == 0 && !drop){
-                cloth[i][j].vel = glm::vec3(0,0,0);
-            }
-            else if (distToOrigin <= .55){
-                glm::vec3 n = -1.0f*(sphereCenter - cloth[i][j].pos);
-                n = n/distToOrigin;
-                glm::vec3 bounce = dot(cloth[i][j].vel,n)*n;
-                cloth[i][j].vel -= (bounce);
-                float bounceScale = (.55 - distToOrigin);
-                bounce = bounceScale*n;
-                cloth[i][j].pos += bounce;
-            }
-            else{
-                glm::vec3 a = glm::vec3(wind*dt,gravity,0.f);
-                cloth[i][j].vel += a;
-                //aero force
-                glm::vec3 vel;
-                glm::vec3 n1;
-                if (i < N-1 && j < N-1){
-                    vel = (cloth[i][j].vel+cloth[i+1][j].vel+cloth[i+1][j+1].vel)/3.0f;
-                    //vel = vel - glm::vec3(wind*dt,0,0);
-                    n1 = cross(cloth[i+1][j].pos - cloth[i][j].pos, cloth[i+1][j+1].pos - cloth[i][j].pos);
-                }
-                else if (i == N-1 && j < N-1){
-                    vel = (cloth[i][j].vel+cloth[i-1][j].vel+cloth[i-1][j+1].vel)/3.0f;
-                   // vel = vel - glm::vec3(wind*dt,0,0);
-                    n1 = cross(cloth[i-1][j+1].pos - cloth[i][j].pos,cloth[i-1][j].pos - cloth[i][j].pos);
-
-                }
-                else if (i == 0 && j == N-1){
-                    vel = (cloth[i][j].vel+cloth[i+1][j].vel+cloth[i+1][j-1].vel)/3.0f;
-                    //vel = vel - glm::vec3(wind*dt,0,0);
-                    n1 = cross(cloth[i+1][j-1].pos - cloth[i][j].pos,cloth[i+1][j].pos - cloth[i][j].pos);
-
-                }
-                else{
-                    vel = (cloth[i][j].vel+cloth[i-1][j].vel+cloth[i-1][j-1].vel)/3.0f;
-                    //vel = vel - glm::vec3(wind*dt,0,0);
-                    n1 = cross(cloth[i-1][j].pos - cloth[i][j].pos, cloth[i-1][j-1].pos - cloth[i][j].pos);
-                }
-                float va = (sqrt(dot(vel,vel))*dot(vel,n1)) / (-4.0f*sqrt(dot(n1,n1)));
-                glm::vec3 aeroForce = va*n1;
-                cloth[i][j].vel += aeroForce;
-                cloth[i][j].pos += cloth[i][j].vel*dt;
-                if (cloth[i][j].pos[1] < -2.0f){
-                    cloth[i][j].pos[1] = -2.0f;
-                }
-            }
-            //calculate normals
-            if (i < (N-1)){
-                glm::vec3 a = normalize(cloth[i+1][j].pos - cloth[i][j].pos);
-                glm::vec3 b = normalize(cloth[i][j+1].pos - cloth[i][j].pos);
-                glm::vec3 normal = cross(b,a);
-                cloth[i][j].norm = normal;
-            }
-            else{
-                glm::vec3 a = normalize(cloth[i-1][j].pos - cloth[i][j].pos);
-                glm::vec3 b = normalize(cloth[i][j-1].pos - cloth[i][j].pos);
-                glm::vec3 normal = cross(b,a);
-                cloth[i][j].norm = normal;
-            }
-        }
+    else{
+        glBufferData(GL_ARRAY_BUFFER, bytes, NULL, GL_STREAM_DRAW);
     }
 }
 
-void midpointUpdate(float dt){
-    //printCloth();
-    //vertical
-    float halfDt = dt / 2.0;
-    for (int i = 0; i < N-1; i++){
-        for (int j = 0; j < N; j++){
-            glm::vec3 e = cloth[i+1][j].pos - cloth[i][j].pos;
-            float l = sqrt(dot(e,e));
-            e = e * (1.0f/l);
-            float v1 = dot(e,cloth[i][j].vel);
-            float v2 = dot(e,cloth[i+1][j].vel);
-            float f = (-1.0f*ks*(l0-l))-(kd*(v1-v2));
-            cloth[i][j].futureVel = cloth[i][j].vel + f*e;
-            cloth[i+1][j].futureVel = cloth[i+1][j].vel - f*e;
-        }
-    }
-    //horizontal
-    for (int i = 0; i < N; i++){
-        for (int j = 0; j < N-1; j++){
-            glm::vec3 e = cloth[i][j+1].pos - cloth[i][j].pos;
-            float l = sqrt(dot(e,e));
-            e = e * (1.0f/l);
-            float v1 = dot(e,cloth[i][j].vel);
-            float v2 = dot(e,cloth[i][j+1].vel);
-            float f = (-1.0f*ks*(l0-l))-(kd*(v1-v2));
-            cloth[i][j].futureVel += f*e;
-            cloth[i][j+1].futureVel -= f*e;
-        }
+ClothStream::~ClothStream(){
+    for (int r = 0; r < STREAM_REGIONS; r++){
+        if (fences[r]) glDeleteSync(fences[r]);
+        fences[r] = 0;
     }
-    //find state at 1/2 timestep
-    for (int i = 0; i < N; i++){
-        for (int j = 0; j < N; j++){
-            if (cloth[i][j].pos[1] - (-2.0) < .02f){
-                continue;
-            }
-            else{
-                glm::vec3 a = glm::vec3(wind,gravity,0.f);
-                cloth[i][j].futureVel += a;
-                cloth[i][j].futurePos += cloth[i][j].futureVel*halfDt;
-            }
-        }
-    }
-    
-    //vertical
-    for (int i = 0; i < N-1; i++){
-        for (int j = 0; j < N; j++){
-            glm::vec3 e = cloth[i+1][j].futurePos - cloth[i][j].futurePos;//
-            float l = sqrt(dot(e,e));
-            e = e * (1.0f/l);
-            float v1 = dot(e,cloth[i][j].futureVel);
-            float v2 = dot(e,cloth[i+1][j].futureVel);
-            float f = (-1.0f*ks*(l0-l))-(kd*(v1-v2));
-            cloth[i][j].vel += f*e;
-            cloth[i+1][j].vel -= f*e;
-        }
-    }
-    //horizontal
-    for (int i = 0; i < N; i++){
-        for (int j = 0; j < N-1; j++){
-            glm::vec3 e = cloth[i][j+1].futurePos - cloth[i][j].futurePos;
-            float l = sqrt(dot(e,e));
-            e = e * (1.0f/l);
-            float v1 = dot(e,cloth[i][j].futureVel);
-            float v2 = dot(e,cloth[i][j+1].futureVel);
-            float f = (-1.0f*ks*(l0-l))-(kd*(v1-v2));
-            cloth[i][j].vel += f*e;
-            cloth[i][j+1].vel -= f*e;
-        }
-    }
-    //change pos
-    for (int i = 0; i < N; i++){
-        for (int j = 0; j < N; j++){
-            float distToOrigin = sqrt(dot(cloth[i][j].futurePos-sphereCenter,cloth[i][j].futurePos-sphereCenter));
-            if (cloth[i][j].futurePos[1] - (-2.0) < .02f){
-                continue;
-            }
-            //            if (i == 0 && (j == 0 || j == N-1)){
-            //                cloth[i][j].vel = glm::vec3(0,0,0);
-            //            }
-            if (i == 0 && !drop){
-                cloth[i][j].vel = glm::vec3(0,0,0);
-            }
-            else if (distToOrigin <= .55 && false){
-                glm::vec3 n = -1.0f*(sphereCenter - cloth[i][j].futurePos);
-                n = n/distToOrigin;
-                glm::vec3 bounce = dot(cloth[i][j].futureVel,n)*n;
-                cloth[i][j].vel -= (bounce);
-                float bounceScale = (.55 - distToOrigin);
-                bounce = bounceScale*n;
-                cloth[i][j].pos += bounce;
-            }
-            else{
-                glm::vec3 a = glm::vec3(wind,gravity,0.f);
-                cloth[i][j].vel += a;
-                cloth[i][j].pos += cloth[i][j].futureVel*dt;
-                if (cloth[i][j].pos[1] < -2.0f){
-                    cloth[i][j].pos[1] = -2.0f;
-                }
-            }
-            cloth[i][j].futureVel = cloth[i][j].vel;
-            cloth[i][j].futurePos = cloth[i][j].pos;
-            //calculate normals
-            if (i < (N-1)){
-                glm::vec3 a = normalize(cloth[i+1][j].pos - cloth[i][j].pos);
-                glm::vec3 b = normalize(cloth[i][j+1].pos - cloth[i][j].pos);
-                glm::vec3 normal = cross(b,a);
-                cloth[i][j].norm = normal;
-            }
-            else{
-                glm::vec3 a = normalize(cloth[i-1][j].pos - cloth[i][j].pos);
-                glm::vec3 b = normalize(cloth[i][j-1].pos - cloth[i][j].pos);
-                glm::vec3 normal = cross(b,a);
-                cloth[i][j].norm = normal;
-            }
-        }
+    if (persistent){
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+        persistent = NULL;
     }
+}
 
+float* ClothStream::map(){
+    if (fences[region]){
+        //flush once so the fence is sure to signal, then keep waiting a second at a time
+        GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+        while (glClientWaitSync(fences[region], flags, 1000000000) == GL_TIMEOUT_EXPIRED) flags = 0;
+        glDeleteSync(fences[region]);
+        fences[region] = 0;
+    }
+    if (persistent) return persistent + region*regionFloats;
+    //the fence already kept us off the GPU's reads, so the driver need not synchronize
+    GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT;
+    return (float*)glMapBufferRange(GL_ARRAY_BUFFER, (GLintptr)region*regionFloats*sizeof(float),
+                                    regionFloats*sizeof(float), access);
 }
 
-float dot(glm::vec3 v1, glm::vec3 v2){
-    return (v1[0]*v2[0]) + (v1[1]*v2[1]) + (v1[2]*v2[2]);
+GLintptr ClothStream::unmap(){
+    if (!persistent) glUnmapBuffer(GL_ARRAY_BUFFER);
+    return (GLintptr)region*regionFloats*sizeof(float);
 }
 
-glm::vec3 normalize(glm::vec3 v){
-    float magnitude = sqrt(dot(v,v));
-    return v*(1/magnitude);
+void ClothStream::fence(){
+    fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    region = (region+1) % STREAM_REGIONS;
 }
 
-glm::vec3 cross(glm::vec3 a, glm::vec3 b){
-    float x = a[1]*b[2] - a[2]*b[1];
-    float y = a[2]*b[0] - a[0]*b[2];
-    float z = a[0]*b[1] - a[1]*b[0];
-    return glm::vec3(x,y,z);
+//Particle k becomes vertex k, buildClothIndices stitches them into triangles
+void flattenClothMatrix(Cloth& cloth, float* clothData){
+    
+    int N = cloth.n;
+    for (int k = 0; k < N*N; k++){
+        flattenVertex(cloth, k, clothData+8*k);
+    }
+    //    for (int i = 0; i < 3*N*N; i+=3){
+    //        printf("(%f %f %f)\n",clothData[i],clothData[i+1],clothData[i+2]);
+    //    }
 }
 
+//Two triangles per grid quad, 6 indices each, in the order flattenClothMatrix used to expand them
+void buildClothIndices(int N, GLuint* indices){
+    for (int i = 0; i < N-1; i++){
+        for (int j = 0; j < N-1; j++){
+            GLuint* quad = indices + 6*(i*(N-1)+j);
+            GLuint k = i*N+j;
+            //TRIANGLE 1
+            quad[0] = k;
+            quad[1] = k+N;
+            quad[2] = k+1;
+            //TRIANGLE 2
+            quad[3] = k+N;
+            quad[4] = k+N+1;
+            quad[5] = k+1;
+        }
+    }
+}
 
 // Create a NULL-terminated string by reading the provided file
 static char* readShaderSource(const char* shaderFile)
@@ -0,0 +1,726 @@
+#include "clothSim.h"
+#include "implicitSolver.h"
+#include "xpbdSolver.h"
+#include "projectiveSolver.h"
+#include "collision.h"
+#include "selfCollision.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <algorithm>
+using namespace std;
+
+ThreadPool* threadPool = NULL;
+
+//Forces are per second. The defaults are the original per-frame tuning
+//(ks 35, kd .5, gravity -.05) scaled to a 1/60 s step
+SimParams::SimParams(){
+    //ks = 1500;
+    //kd = 20.f;
+    ks = 2100;
+    kd = 30;
+    gravity = -3.0;
+    aero = 60;
+    wind = 0.0f;
+    drop = false;
+    sphereCenter = glm::vec3(0,0,0);
+    sphere = true;
+    integrator = EULER;
+    cgIterations = 100;
+    cgTolerance = 1e-4f;
+    solverIterations = 10;
+    compliance = -1.0f; //follow ks
+    sleepEnergy = 0.0f;
+    sleepSteps = 30;
+    selfThickness = 0.0f;
+    ccd = false;
+    tiled = false;
+}
+
+//Arrays are padded to a multiple of 8 floats and aligned for 32 byte vector loads
+float* allocateFloats(int count){
+    void* mem = NULL;
+    size_t padded = ((count + 7) / 8) * 8;
+    if (posix_memalign(&mem, 32, padded*sizeof(float)) != 0){
+        printf("Error: could not allocate %d floats\n", count); exit(1);
+    }
+    memset(mem, 0, padded*sizeof(float));
+    return (float*)mem;
+}
+
+Vec3Array::Vec3Array(){
+    x = NULL; y = NULL; z = NULL;
+}
+
+void Vec3Array::allocate(int count){
+    release();
+    x = allocateFloats(count);
+    y = allocateFloats(count);
+    z = allocateFloats(count);
+}
+
+void Vec3Array::release(){
+    free(x); free(y); free(z);
+    x = NULL; y = NULL; z = NULL;
+}
+
+void Vec3Array::copy(const Vec3Array& from, int count){
+    memcpy(x, from.x, count*sizeof(float));
+    memcpy(y, from.y, count*sizeof(float));
+    memcpy(z, from.z, count*sizeof(float));
+}
+
+Cloth::Cloth(int _n){
+    n = _n;
+    l0 = 0.0f;
+    pos.allocate(n*n);
+    vel.allocate(n*n);
+    norm.allocate(n*n);
+    faceNormal.allocate((n+1)*(n+1));
+    faceAero.allocate((n+1)*(n+1));
+    texU = allocateFloats(n*n);
+    texV = allocateFloats(n*n);
+    implicitSolver = NULL;
+    xpbdSolver = NULL;
+    projectiveSolver = NULL;
+    sleep = NULL;
+    selfCollision = NULL;
+    sweep = NULL;
+    obstacleGrid = NULL;
+}
+
+Cloth::~Cloth(){
+    pos.release();
+    vel.release();
+    norm.release();
+    faceNormal.release();
+    faceAero.release();
+    futurePos.release();
+    futureVel.release();
+    free(texU);
+    free(texV);
+    delete implicitSolver;
+    delete xpbdSolver;
+    delete projectiveSolver;
+    delete sleep;
+    delete selfCollision;
+    delete sweep;
+    delete obstacleGrid;
+}
+
+SleepState::SleepState(int _n){
+    n = _n;
+    asleep = new bool[n];
+    calmSteps = new int[n];
+    for (int color = 0; color < 2; color++){
+        springRows[color] = new int[n];
+        awakeRows[color] = new int[n];
+        springCount[color] = 0;
+        awakeCount[color] = 0;
+    }
+    awake = new int[n];
+    awakeTotal = 0;
+    rowsUpdated = 0;
+    rowsSkipped = 0;
+    wakeAll();
+}
+
+SleepState::~SleepState(){
+    delete[] asleep;
+    delete[] calmSteps;
+    for (int color = 0; color < 2; color++){
+        delete[] springRows[color];
+        delete[] awakeRows[color];
+    }
+    delete[] awake;
+}
+
+void SleepState::wakeAll(){
+    for (int i = 0; i < n; i++){
+        asleep[i] = false;
+        calmSteps[i] = 0;
+    }
+}
+
+void Cloth::allocateMidpointState(){
+    if (futurePos.allocated()) return;
+    futurePos.allocate(n*n);
+    futureVel.allocate(n*n);
+    for (int k = 0; k < n*n; k++){
+        futurePos.set(k, pos.get(k));
+        futureVel.set(k, vel.get(k));
+    }
+}
+
+//Call body(row) for rows first, first+step, ... below end, in parallel when a pool exists
+void forEachRow(int first, int end, int step, const function<void(int)>& body){
+    int count = (end - first + step - 1) / step;
+    if (threadPool == NULL){
+        for (int r = 0; r < count; r++) body(first + r*step);
+        return;
+    }
+    threadPool->parallelFor(0, count, [&](int lo, int hi){
+        for (int r = lo; r < hi; r++) body(first + r*step);
+    });
+}
+
+//Call body(row) for every row in the list, in parallel when a pool exists
+static void forEachListed(const int* rows, int count, const function<void(int)>& body){
+    if (threadPool == NULL){
+        for (int r = 0; r < count; r++) body(rows[r]);
+        return;
+    }
+    threadPool->parallelFor(0, count, [&](int lo, int hi){
+        for (int r = lo; r < hi; r++) body(rows[r]);
+    });
+}
+
+void initializeCloth(Cloth& cloth, float spacing){
+    
+    int N = cloth.n;
+    cloth.l0 = spacing;
+    float clothWidth = spacing*(N-1);
+    float currX = -clothWidth/2.0;
+    float initZ = -clothWidth/2.0;
+    float currZ;
+    for (int i = 0; i < N; i++){
+        currZ = initZ;
+        for (int j = 0; j < N; j++){
+            int k = cloth.index(i,j);
+            cloth.pos.set(k, glm::vec3(currX,clothHeight,currZ));
+            cloth.vel.set(k, glm::vec3(0.0f,0.0f,0.0f));
+            cloth.norm.set(k, glm::vec3(0.f,1.f,0.f));
+            cloth.texU[k] = j/(float)(N-1);
+            cloth.texV[k] = i/(float)(N-1);
+            currZ += spacing;
+        }
+        currX += spacing;
+    }
+    if (cloth.futurePos.allocated()){
+        cloth.futurePos.release();
+        cloth.futureVel.release();
+        cloth.allocateMidpointState();
+    }
+    if (cloth.sleep != NULL){
+        cloth.sleep->wakeAll();
+    }
+}
+
+void printCloth(Cloth& cloth){
+        int N = cloth.n;
+        for (int i = 0; i < N; i++){
+            for (int j = 0; j < N; j++){
+                int k = cloth.index(i,j);
+                printf("(%.2g, %.2g, %.2g) ",cloth.vel.x[k],cloth.vel.y[k],cloth.vel.z[k]);
+            }
+            printf("\n");
+        }
+        printf("\n");
+}
+
+//Push particle k out to the sphere surface and remove its velocity along the surface normal,
+//returns false when it is outside the sphere
+bool collideSphere(Cloth& cloth, const SimParams& params, int k){
+    if (!params.sphere){
+        return false;
+    }
+    glm::vec3 p = cloth.pos.get(k);
+    float distToOrigin = sqrt(dot(p-params.sphereCenter,p-params.sphereCenter));
+    if (distToOrigin > .55){
+        return false;
+    }
+    glm::vec3 n = -1.0f*(params.sphereCenter - p);
+    n = n/distToOrigin;
+    glm::vec3 bounce = dot(cloth.vel.get(k),n)*n;
+    cloth.vel.sub(k, bounce);
+    float bounceScale = (.55 - distToOrigin);
+    bounce = bounceScale*n;
+    cloth.pos.add(k, bounce);
+    return true;
+}
+
+//Sum of a per quad value over the (up to four) quads around particle (i,j)
+static glm::vec3 aroundParticle(const Cloth& cloth, const Vec3Array& faces, int i, int j){
+    int f = cloth.face(i-1,j-1), g = cloth.face(i,j-1);
+    return faces.get(f) + faces.get(f+1) + faces.get(g) + faces.get(g+1);
+}
+
+void computeNormals(Cloth& cloth){
+    forEachRow(0, cloth.n, 1, [&](int i){ springKernels.normals(cloth, i); });
+}
+
+//Face normals and aero impulses of the quads in row i. The air pushes a quad against its normal
+//velocity, scaled by its speed and a quarter of its area (|n|/8), and each corner takes a quarter
+//of the push.
+static void aeroRow(Cloth& cloth, const SimParams& params, int i, float dt){
+    //backward Euler on the drag for the implicit integrator, a long step then damps the flow
+    //through the face instead of reversing it
+    float drag = params.integrator == IMPLICIT ? params.aero*dt/8.0f : 0.0f;
+    springKernels.aero(cloth, i, -params.aero*dt/32.0f, drag);
+}
+
+//change pos and collisions for row i, needs aeroRow for the quad rows around it
+static void updateRow(Cloth& cloth, const SimParams& params, int i, float dt){
+    int N = cloth.n;
+    Vec3Array& pos = cloth.pos;
+    Vec3Array& vel = cloth.vel;
+    for (int j = 0; j < N; j++){
+        int k = cloth.index(i,j);
+        glm::vec3 p = pos.get(k);
+        if (p[1] - (-2.0) < .02f){
+            continue;
+        }
+//            if (i == 0 && (j == 0 || j == N-1)){
+//                vel.set(k, glm::vec3(0,0,0));
+//            }
+        if (i == 0 && !params.drop){
+            vel.set(k, glm::vec3(0,0,0));
+        }
+        //the sphere pushes the particle out, otherwise apply the forces and move it
+        else if (!collideSphere(cloth, params, k)){
+            glm::vec3 a = glm::vec3(params.wind,params.gravity,0.f)*dt;
+            vel.add(k, a);
+            vel.add(k, aroundParticle(cloth, cloth.faceAero, i, j));
+            pos.add(k, vel.get(k)*dt);
+            if (pos.y[k] < -2.0f){
+                pos.y[k] = -2.0f;
+            }
+        }
+    }
+}
+
+//Anything that changes the forces on resting cloth wakes every row
+static bool sceneChanged(const SimParams& a, const SimParams& b){
+    return a.ks != b.ks || a.kd != b.kd || a.gravity != b.gravity || a.aero != b.aero ||
+           a.wind != b.wind || a.drop != b.drop || a.sphereCenter != b.sphereCenter ||
+           a.sphere != b.sphere || a.colliders != b.colliders || a.selfThickness != b.selfThickness;
+}
+
+//update() restricted to the awake rows and the springs touching them
+static void sleepingUpdate(Cloth& cloth, const SimParams& params, float dt){
+    int N = cloth.n;
+    if (cloth.sleep == NULL){
+        cloth.sleep = new SleepState(N);
+    }
+    SleepState& sleep = *cloth.sleep;
+    if (sceneChanged(sleep.last, params)){
+        sleep.wakeAll();
+    }
+    sleep.last = params;
+    //active set, the vertical spring below row i runs when either of its rows is awake
+    sleep.awakeTotal = 0;
+    for (int color = 0; color < 2; color++){
+        sleep.springCount[color] = 0;
+        sleep.awakeCount[color] = 0;
+    }
+    for (int i = 0; i < N; i++){
+        if (i < N-1 && (!sleep.asleep[i] || !sleep.asleep[i+1])){
+            sleep.springRows[i%2][sleep.springCount[i%2]++] = i;
+        }
+        if (!sleep.asleep[i]){
+            sleep.awakeRows[i%2][sleep.awakeCount[i%2]++] = i;
+            sleep.awake[sleep.awakeTotal++] = i;
+        }
+    }
+    sleep.rowsUpdated += sleep.awakeTotal;
+    sleep.rowsSkipped += N - sleep.awakeTotal;
+
+    for (int color = 0; color < 2; color++){
+        forEachListed(sleep.springRows[color], sleep.springCount[color], [&](int i){ springKernels.vertical(cloth, i, params.ks*dt, params.kd*dt); });
+    }
+    forEachListed(sleep.awake, sleep.awakeTotal, [&](int i){ springKernels.horizontal(cloth, i, params.ks*dt, params.kd*dt); });
+    //sleeping rows hold their springs, drop the impulse those springs gave them
+    for (int color = 0; color < 2; color++){
+        for (int r = 0; r < sleep.springCount[color]; r++){
+            int i = sleep.springRows[color][r];
+            for (int row = i; row <= i+1; row++){
+                if (!sleep.asleep[row]) continue;
+                for (int k = cloth.index(row,0); k < cloth.index(row+1,0); k++) cloth.vel.set(k, glm::vec3(0,0,0));
+            }
+        }
+    }
+    //the quads around the awake rows are the ones under the active vertical springs
+    for (int color = 0; color < 2; color++){
+        forEachListed(sleep.springRows[color], sleep.springCount[color], [&](int i){ aeroRow(cloth, params, i, dt); });
+    }
+    for (int color = 0; color < 2; color++){
+        forEachListed(sleep.awakeRows[color], sleep.awakeCount[color], [&](int i){ updateRow(cloth, params, i, dt); });
+    }
+    if (!params.colliders.empty()){
+        buildObstacleGrid(cloth, params);
+        forEachListed(sleep.awake, sleep.awakeTotal, [&](int i){ collideRow(cloth, params, i, dt); });
+    }
+    collideSelf(cloth, params, sleep.asleep);
+
+    //count calm steps, particles resting on the floor never move so they do not count
+    forEachListed(sleep.awake, sleep.awakeTotal, [&](int i){
+        float energy = 0.0f;
+        for (int k = cloth.index(i,0); k < cloth.index(i+1,0); k++){
+            if (cloth.pos.y[k] - (-2.0) < .02f) continue;
+            glm::vec3 v = cloth.vel.get(k);
+            float e = .5f*dot(v,v);
+            //written so a NaN keeps the row awake
+            if (!(e <= energy)) energy = e;
+        }
+        sleep.calmSteps[i] = energy < params.sleepEnergy ? sleep.calmSteps[i]+1 : 0;
+    });
+    for (int r = 0; r < sleep.awakeTotal; r++){
+        int i = sleep.awake[r];
+        if (sleep.calmSteps[i] >= params.sleepSteps){
+            sleep.asleep[i] = true;
+            for (int k = cloth.index(i,0); k < cloth.index(i+1,0); k++) cloth.vel.set(k, glm::vec3(0,0,0));
+        }
+    }
+    //a row that moved this step wakes its neighbours
+    for (int r = 0; r < sleep.awakeTotal; r++){
+        int i = sleep.awake[r];
+        if (sleep.calmSteps[i] > 0) continue;
+        for (int row = i-1; row <= i+1; row += 2){
+            if (row >= 0 && row < N && sleep.asleep[row]){
+                sleep.asleep[row] = false;
+                sleep.calmSteps[row] = 0;
+            }
+        }
+    }
+}
+
+//update() as a wavefront down the rows. Each row goes through every phase while it and its
+//neighbours are still in cache: at step t the even vertical spring t and the odd spring t-1 (which
+//reads the velocities the even springs on both sides left), the horizontal springs of row t-1, now
+//done with vertical springs, the aero pass of quad row t-2, whose rows are both done with springs,
+//and finally row t-2 moves and collides. The two row lag is the halo, every row is read by a
+//phase before it is written by the next one in the same order update() uses.
+static void tiledUpdate(Cloth& cloth, const SimParams& params, float dt){
+    int N = cloth.n;
+    float ks = params.ks*dt, kd = params.kd*dt;
+    if (!params.colliders.empty()){
+        buildObstacleGrid(cloth, params);
+    }
+    for (int t = 0; t <= N+1; t++){
+        if (t%2 == 0 && t < N-1) springKernels.vertical(cloth, t, ks, kd);
+        if (t%2 == 0 && t >= 2 && t-1 < N-1) springKernels.vertical(cloth, t-1, ks, kd);
+        if (t >= 1 && t-1 < N) springKernels.horizontal(cloth, t-1, ks, kd);
+        int r = t-2;
+        if (r < 0 || r >= N) continue;
+        if (r < N-1) aeroRow(cloth, params, r, dt);
+        updateRow(cloth, params, r, dt);
+        collideRow(cloth, params, r, dt);
+    }
+    collideSelf(cloth, params, NULL);
+}
+
+void update(Cloth& cloth, const SimParams& params, float dt){
+    if (params.sleepEnergy > 0.0f){
+        sleepingUpdate(cloth, params, dt);
+        return;
+    }
+    if (params.tiled){
+        tiledUpdate(cloth, params, dt);
+        return;
+    }
+    int N = cloth.n;
+    //printCloth();
+    //vertical, even rows then odd rows so no two threads write the same particle
+    for (int color = 0; color < 2; color++){
+        forEachRow(color, N-1, 2, [&](int i){ springKernels.vertical(cloth, i, params.ks*dt, params.kd*dt); });
+    }
+    //horizontal, springs in different rows never share a particle
+    forEachRow(0, N, 1, [&](int i){ springKernels.horizontal(cloth, i, params.ks*dt, params.kd*dt); });
+    integratePositions(cloth, params, dt);
+    collideSelf(cloth, params, NULL);
+}
+
+//Gravity, wind, aero, positions and collisions once the springs have changed vel
+void integratePositions(Cloth& cloth, const SimParams& params, float dt){
+    forEachRow(0, cloth.n-1, 1, [&](int i){ aeroRow(cloth, params, i, dt); });
+    //row i only reads faceAero, which the aero pass has finished, and writes its own particles
+    forEachRow(0, cloth.n, 1, [&](int i){ updateRow(cloth, params, i, dt); });
+    collideObstacles(cloth, params, dt);
+}
+
+//Impulse the spring between a and b adds to a (and removes from b) for the given state
+static glm::vec3 springImpulse(Cloth& cloth, const SimParams& params, Vec3Array& springPos, Vec3Array& springVel, int a, int b, float dt){
+    glm::vec3 e = springPos.get(b) - springPos.get(a);
+    float l = sqrt(dot(e,e));
+    e = e * (1.0f/l);
+    float v1 = dot(e,springVel.get(a));
+    float v2 = dot(e,springVel.get(b));
+    float f = ((-1.0f*params.ks*(cloth.l0-l))-(params.kd*(v1-v2)))*dt;
+    return f*e;
+}
+
+//change pos and collisions for row i after the midpoint springs
+static void midpointRow(Cloth& cloth, const SimParams& params, int i, float dt){
+    int N = cloth.n;
+    Vec3Array& pos = cloth.pos;
+    Vec3Array& vel = cloth.vel;
+    Vec3Array& futurePos = cloth.futurePos;
+    Vec3Array& futureVel = cloth.futureVel;
+    for (int j = 0; j < N; j++){
+        int k = cloth.index(i,j);
+        glm::vec3 fp = futurePos.get(k);
+        float distToOrigin = sqrt(dot(fp-params.sphereCenter,fp-params.sphereCenter));
+        if (fp[1] - (-2.0) < .02f){
+            continue;
+        }
+        //            if (i == 0 && (j == 0 || j == N-1)){
+        //                vel.set(k, glm::vec3(0,0,0));
+        //            }
+        if (i == 0 && !params.drop){
+            vel.set(k, glm::vec3(0,0,0));
+        }
+        else if (distToOrigin <= .55 && false){
+            glm::vec3 n = -1.0f*(params.sphereCenter - fp);
+            n = n/distToOrigin;
+            glm::vec3 bounce = dot(futureVel.get(k),n)*n;
+            vel.sub(k, bounce);
+            float bounceScale = (.55 - distToOrigin);
+            bounce = bounceScale*n;
+            pos.add(k, bounce);
+        }
+        else{
+            glm::vec3 a = glm::vec3(params.wind,params.gravity,0.f)*dt;
+            vel.add(k, a);
+            pos.add(k, futureVel.get(k)*dt);
+            if (pos.y[k] < -2.0f){
+                pos.y[k] = -2.0f;
+            }
+        }
+        futureVel.set(k, vel.get(k));
+        futurePos.set(k, pos.get(k));
+    }
+}
+
+void midpointUpdate(Cloth& cloth, const SimParams& params, float dt){
+    int N = cloth.n;
+    cloth.allocateMidpointState();
+    Vec3Array& pos = cloth.pos;
+    Vec3Array& vel = cloth.vel;
+    Vec3Array& futurePos = cloth.futurePos;
+    Vec3Array& futureVel = cloth.futureVel;
+    //printCloth();
+    float halfDt = dt / 2.0;
+    //vertical, futureVel of row i is overwritten by the spring below it, so row i
+    //only keeps its own spring (and the last row the one above it)
+    forEachRow(0, N-1, 1, [&](int i){
+        for (int j = 0; j < N; j++){
+            int k = cloth.index(i,j);
+            glm::vec3 fe = springImpulse(cloth, params, pos, vel, k, k+N, dt);
+            futureVel.set(k, vel.get(k) + fe);
+            if (i == N-2){
+                futureVel.set(k+N, vel.get(k+N) - fe);
+            }
+        }
+    });
+    //horizontal
+    forEachRow(0, N, 1, [&](int i){
+        for (int j = 0; j < N-1; j++){
+            int k = cloth.index(i,j);
+            glm::vec3 fe = springImpulse(cloth, params, pos, vel, k, k+1, dt);
+            futureVel.add(k, fe);
+            futureVel.sub(k+1, fe);
+        }
+    });
+    //find state at 1/2 timestep
+    forEachRow(0, N, 1, [&](int i){
+        for (int k = cloth.index(i,0); k < cloth.index(i+1,0); k++){
+            if (pos.y[k] - (-2.0) < .02f){
+                continue;
+            }
+            else{
+                glm::vec3 a = glm::vec3(params.wind,params.gravity,0.f)*dt;
+                futureVel.add(k, a);
+                futurePos.add(k, futureVel.get(k)*halfDt);
+            }
+        }
+    });
+    
+    //vertical
+    for (int color = 0; color < 2; color++){
+        forEachRow(color, N-1, 2, [&](int i){
+            for (int j = 0; j < N; j++){
+                int k = cloth.index(i,j);
+                glm::vec3 fe = springImpulse(cloth, params, futurePos, futureVel, k, k+N, dt);
+                vel.add(k, fe);
+                vel.sub(k+N, fe);
+            }
+        });
+    }
+    //horizontal
+    forEachRow(0, N, 1, [&](int i){
+        for (int j = 0; j < N-1; j++){
+            int k = cloth.index(i,j);
+            glm::vec3 fe = springImpulse(cloth, params, futurePos, futureVel, k, k+1, dt);
+            vel.add(k, fe);
+            vel.sub(k+1, fe);
+        }
+    });
+    //change pos
+    for (int color = 0; color < 2; color++){
+        forEachRow(color, N, 2, [&](int i){ midpointRow(cloth, params, i, dt); });
+    }
+}
+
+SimClock::SimClock(float _fixedDt, int _maxSubsteps){
+    fixedDt = _fixedDt;
+    maxSubsteps = _maxSubsteps;
+    accumulator = 0.0f;
+}
+
+//Add a rendered frame's wall-clock time and return how many fixed steps to run for it.
+//Time beyond maxSubsteps steps is dropped so a slow frame cannot snowball.
+int SimClock::advance(float frameTime){
+    accumulator += max(frameTime, 0.0f);
+    int substeps = (int)(accumulator / fixedDt);
+    if (substeps > maxSubsteps){
+        substeps = maxSubsteps;
+        accumulator = 0.0f;
+    }
+    else{
+        accumulator -= substeps*fixedDt;
+    }
+    return substeps;
+}
+
+Ensemble::Ensemble(int count, int n){
+    for (int m = 0; m < count; m++){
+        Cloth* cloth = new Cloth(n);
+        initializeCloth(*cloth, clothSize/(n-1));
+        cloths.push_back(cloth);
+    }
+    params.resize(count);
+}
+
+Ensemble::~Ensemble(){
+    for (size_t m = 0; m < cloths.size(); m++) delete cloths[m];
+}
+
+void Ensemble::step(float dt){
+    if (threadPool == NULL){
+        for (int m = 0; m < size(); m++) ::step(*cloths[m], params[m], dt);
+        return;
+    }
+    //the row loops inside each instance's step start while the pool is busy, so they run serially
+    threadPool->parallelFor(0, size(), [&](int lo, int hi){
+        for (int m = lo; m < hi; m++) ::step(*cloths[m], params[m], dt);
+    });
+}
+
+AdaptiveStepper::AdaptiveStepper(float _tolerance, float _minDt, float _maxDt){
+    tolerance = _tolerance;
+    minDt = _minDt;
+    maxDt = _maxDt;
+    dt = _minDt;
+    accepted = 0;
+    rejected = 0;
+}
+
+AdaptiveStepper::~AdaptiveStepper(){
+    savedVel.release();
+}
+
+//Take one accepted step of at most maxStep and return its length. A rejected step is retried
+//with a smaller dt, a step at minDt is always accepted. Steps run the implicit integrator, the
+//explicit ones are already at their stability limit at the default dt and have nothing to grow
+//into. The solve only changes vel, so a rejection only has to put vel back.
+float AdaptiveStepper::advance(Cloth& cloth, const SimParams& params, float maxStep){
+    int N = cloth.n;
+    if (!savedVel.allocated()){
+        savedVel.allocate(N*N);
+    }
+    if (cloth.implicitSolver == NULL){
+        cloth.implicitSolver = new ImplicitSolver(N);
+    }
+    beginSweep(cloth, params);
+    savedVel.copy(cloth.vel, N*N);
+    bool retried = false;
+    while (true){
+        float h = min(dt, maxStep);
+        cloth.implicitSolver->solve(cloth, params, h);
+        //Forward Euler predicts pos + h*v0, backward Euler corrects it to pos + h*v1. Both are
+        //first order, so the local error of the corrector is about half their difference
+        //(Milne's device). Spring and gravity impulses only, over the particles updateRow moves.
+        glm::vec3 a = glm::vec3(params.wind,params.gravity,0.f)*h;
+        float error = 0.0f;
+        for (int k = 0; k < N*N; k++){
+            if ((k < N && !params.drop) || cloth.pos.y[k] - (-2.0) < .02f){
+                continue;
+            }
+            glm::vec3 d = (cloth.vel.get(k) + a - savedVel.get(k))*(h/2.0f);
+            float e = dot(d,d);
+            //written so a NaN also counts as the largest error
+            if (!(e <= error)) error = e;
+        }
+        error = sqrt(error);
+        //first order local error grows with h^2, so scale by the square root, 0.9 as a safety margin
+        float scale = 0.3f;
+        if (error == 0.0f) scale = 2.0f;
+        else if (error < INFINITY) scale = min(max(0.9f*sqrt(tolerance/error), 0.3f), 2.0f);
+        if (error <= tolerance || h <= minDt){
+            accepted++;
+            //no growing straight after a rejection, that only brings the rejection back
+            if (retried) scale = min(scale, 1.0f);
+            if (h == dt) dt = min(max(dt*scale, minDt), maxDt);
+            //keep the step, its aero, positions and collisions
+            integratePositions(cloth, params, h);
+            collideSelf(cloth, params, NULL);
+            endSweep(cloth, params, h);
+            return h;
+        }
+        rejected++;
+        retried = true;
+        dt = max(h*scale, minDt);
+        cloth.vel.copy(savedVel, N*N);
+    }
+}
+
+//Advance the cloth by dt with the integrator selected in params
+void step(Cloth& cloth, const SimParams& params, float dt){
+    beginSweep(cloth, params);
+    if (params.integrator == MIDPOINT){
+        midpointUpdate(cloth, params, dt);
+    }
+    else if (params.integrator == IMPLICIT){
+        implicitUpdate(cloth, params, dt);
+    }
+    else if (params.integrator == XPBD){
+        xpbdUpdate(cloth, params, dt);
+    }
+    else if (params.integrator == PROJECTIVE){
+        projectiveUpdate(cloth, params, dt);
+    }
+    else{
+        update(cloth, params, dt);
+    }
+    endSweep(cloth, params, dt);
+}
+
+bool parseIntegrator(const char* name, Integrator& integrator){
+    string s = name;
+    if (s == "euler") integrator = EULER;
+    else if (s == "midpoint") integrator = MIDPOINT;
+    else if (s == "implicit") integrator = IMPLICIT;
+    else if (s == "xpbd") integrator = XPBD;
+    else if (s == "projective") integrator = PROJECTIVE;
+    else return false;
+    return true;
+}
+
+float dot(glm::vec3 v1, glm::vec3 v2){
+    return (v1[0]*v2[0]) + (v1[1]*v2[1]) + (v1[2]*v2[2]);
+}
+
+glm::vec3 normalize(glm::vec3 v){
+    float magnitude = sqrt(dot(v,v));
+    return v*(1/magnitude);
+}
+
+glm::vec3 cross(glm::vec3 a, glm::vec3 b){
+    float x = a[1]*b[2] - a[2]*b[1];
+    float y = a[2]*b[0] - a[0]*b[2];
+    float z = a[0]*b[1] - a[1]*b[0];
+    return glm::vec3(x,y,z);
+}
@@ -0,0 +1,235 @@
+#ifndef CLOTHSIM_H
+#define CLOTHSIM_H
+
+#define GLM_FORCE_RADIANS
+#include "glm/glm.hpp"
+
+#include <functional>
+#include <vector>
+#include "threadPool.h"
+
+//Cloth simulation, shared by the SDL viewer (cloth.cpp) and the headless runner (headless.cpp)
+
+const float clothHeight = 1.0f;
+const float clothSize = 1.82f;
+
+class Collider;
+
+enum Integrator{
+    EULER,
+    MIDPOINT,
+    IMPLICIT,
+    XPBD,
+    PROJECTIVE
+};
+
+//Physical constants and scene state read by the integrators
+struct SimParams{
+    SimParams();
+    float ks;
+    float kd;
+    float gravity;
+    float aero;
+    float wind;
+    bool drop;
+    glm::vec3 sphereCenter;
+    //The analytic sphere at sphereCenter, off when a model is the obstacle instead
+    bool sphere;
+    //Further obstacles, collided with after the particles move
+    std::vector<Collider*> colliders;
+    Integrator integrator;
+    //Conjugate gradient limits for the implicit integrator
+    int cgIterations;
+    float cgTolerance;
+    //XPBD constraint rounds or projective dynamics local/global rounds per step
+    int solverIterations;
+    //XPBD spring compliance (1/stiffness, 0 is inextensible), below 0 it is 1/ks so changing ks
+    //changes the XPBD springs too
+    float compliance;
+    //update() puts a row to sleep once every particle in it stayed below sleepEnergy (per unit
+    //mass) for sleepSteps steps, 0 turns sleeping off
+    float sleepEnergy;
+    int sleepSteps;
+    //Particles are kept this far from the cloth's own triangles, 0 turns self collision off
+    float selfThickness;
+    //Continuous collision against the sphere and colliders, catches particles that pass through
+    //a surface within one step
+    bool ccd;
+    //update() in one sweep down the rows on the calling thread rather than three passes over the
+    //whole grid, for grids too large for the cache. Gives the same result. Sleeping takes
+    //precedence, the sweep does not skip rows.
+    bool tiled;
+};
+
+//Fixed-dt simulation clock, decides how many substeps each rendered frame runs
+class SimClock{
+public:
+    SimClock(float fixedDt, int maxSubsteps);
+    int advance(float frameTime);
+    float fixedDt;
+    int maxSubsteps;
+    float accumulator;
+};
+
+//One vec3 attribute stored as three separate, contiguous and aligned arrays
+class Vec3Array{
+public:
+    Vec3Array();
+    void allocate(int count);
+    void release();
+    void copy(const Vec3Array& from, int count);
+    bool allocated() const { return x != NULL; }
+    glm::vec3 get(int k) const { return glm::vec3(x[k],y[k],z[k]); }
+    void set(int k, glm::vec3 v){ x[k] = v[0]; y[k] = v[1]; z[k] = v[2]; }
+    void add(int k, glm::vec3 v){ x[k] += v[0]; y[k] += v[1]; z[k] += v[2]; }
+    void sub(int k, glm::vec3 v){ x[k] -= v[0]; y[k] -= v[1]; z[k] -= v[2]; }
+    float* x;
+    float* y;
+    float* z;
+};
+
+class ImplicitSolver;
+class SleepState;
+class XpbdSolver;
+class ProjectiveSolver;
+class SelfCollision;
+class SweepState;
+class ObstacleGrid;
+
+//Heap allocated n x n grid stored as structure-of-arrays, particle (i,j) is at index i*n+j
+class Cloth{
+public:
+    Cloth(int n);
+    ~Cloth();
+    int index(int i, int j) const { return i*n + j; }
+    //Quad (i,j) has corners (i,j) and (i+1,j+1). Quads are stored with a ring of zero padding,
+    //so the four around any particle are face(i-1,j-1), face(i-1,j), face(i,j-1) and face(i,j).
+    int face(int i, int j) const { return (i+1)*(n+1) + j+1; }
+    void allocateMidpointState();
+    int n;
+    float l0;
+    Vec3Array pos;
+    Vec3Array vel;
+    //Only for drawing, written by computeNormals and not kept up to date by the steps
+    Vec3Array norm;
+    //Per quad as of the last aero pass, normals (not normalized, their length is twice the quad's
+    //area) and the aero impulse each of its corners takes
+    Vec3Array faceNormal;
+    Vec3Array faceAero;
+    float* texU;
+    float* texV;
+    //Only allocated once midpointUpdate runs
+    Vec3Array futurePos;
+    Vec3Array futureVel;
+    //Only created once implicitUpdate runs
+    ImplicitSolver* implicitSolver;
+    //Only created once xpbdUpdate runs
+    XpbdSolver* xpbdSolver;
+    //Only created once projectiveUpdate runs
+    ProjectiveSolver* projectiveSolver;
+    //Only created once update runs with sleeping turned on
+    SleepState* sleep;
+    //Only created once a step runs with self collision turned on
+    SelfCollision* selfCollision;
+    //Only created once a step runs with continuous collision turned on
+    SweepState* sweep;
+    //Only created once a step runs with colliders
+    ObstacleGrid* obstacleGrid;
+};
+
+//Rows update() skips. A sleeping row does not move and holds its springs like a pinned row,
+//it wakes when the scene parameters or the sphere change or when a neighbouring row moves.
+class SleepState{
+public:
+    SleepState(int n);
+    ~SleepState();
+    void wakeAll();
+    int n;
+    bool* asleep;
+    int* calmSteps;
+    //Compact work lists rebuilt every step, vertical spring rows per color, awake rows per color and all awake rows
+    int* springRows[2];
+    int springCount[2];
+    int* awakeRows[2];
+    int awakeCount[2];
+    int* awake;
+    int awakeTotal;
+    //Scene the rows fell asleep in
+    SimParams last;
+    //Row updates done and skipped, for reporting
+    long long rowsUpdated;
+    long long rowsSkipped;
+};
+
+//Independent cloths of the same size stepped together, for parameter sweeps. Every instance has
+//its own SimParams (colliders may be shared, they are only read). With a thread pool the instances
+//are split between the threads and each one runs its whole step on one thread, which for small
+//grids beats splitting every grid's rows between the threads.
+class Ensemble{
+public:
+    Ensemble(int count, int n);
+    ~Ensemble();
+    int size() const { return (int)cloths.size(); }
+    void step(float dt);
+    std::vector<Cloth*> cloths;
+    std::vector<SimParams> params;
+};
+
+//Error controlled variable dt for the implicit integrator, which stays stable as dt grows. The
+//solve of a step gives the velocity change, half the gap between the forward Euler predicted and
+//the backward Euler position is the local error estimate that accepts, rejects and resizes the
+//step. Aero, positions and collisions only run once the step is accepted.
+class AdaptiveStepper{
+public:
+    AdaptiveStepper(float tolerance, float minDt, float maxDt);
+    ~AdaptiveStepper();
+    float advance(Cloth& cloth, const SimParams& params, float maxStep);
+    float tolerance;
+    float minDt;
+    float maxDt;
+    //Size the next step will try
+    float dt;
+    int accepted;
+    int rejected;
+private:
+    Vec3Array savedVel;
+};
+
+//Spring, aero and normal passes over one row of the cloth, picked at startup by selectSpringKernels
+struct SpringKernels{
+    const char* name;
+    void (*vertical)(Cloth& cloth, int row, float ks, float kd);
+    void (*horizontal)(Cloth& cloth, int row, float ks, float kd);
+    //faceNormal and faceAero of the quads in row, the impulse is scale*speed*dot(v,n)/|n| * n
+    //for the quad's mean velocity v, divided by 1 + drag*speed*|n|
+    void (*aero)(Cloth& cloth, int row, float scale, float drag);
+    //Area weighted norm of the particles in row
+    void (*normals)(Cloth& cloth, int row);
+};
+extern SpringKernels springKernels;
+void selectSpringKernels(const char* name);
+
+//Set when the simulation should run on more than one thread
+extern ThreadPool* threadPool;
+
+//Functions
+void initializeCloth(Cloth& cloth, float spacing);
+void printCloth(Cloth& cloth);
+void step(Cloth& cloth, const SimParams& params, float dt);
+void update(Cloth& cloth, const SimParams& params, float dt);
+void midpointUpdate(Cloth& cloth, const SimParams& params, float dt);
+void implicitUpdate(Cloth& cloth, const SimParams& params, float dt);
+void xpbdUpdate(Cloth& cloth, const SimParams& params, float dt);
+void projectiveUpdate(Cloth& cloth, const SimParams& params, float dt);
+void integratePositions(Cloth& cloth, const SimParams& params, float dt);
+bool collideSphere(Cloth& cloth, const SimParams& params, int k);
+//Bring norm up to date with pos, once per drawn frame rather than every step
+void computeNormals(Cloth& cloth);
+float* allocateFloats(int count);
+bool parseIntegrator(const char* name, Integrator& integrator);
+void forEachRow(int first, int end, int step, const std::function<void(int)>& body);
+float dot(glm::vec3 v1, glm::vec3 v2);
+glm::vec3 cross(glm::vec3 a, glm::vec3 b);
+glm::vec3 normalize(glm::vec3);
+
+#endif
@@ -0,0 +1,766 @@
+#include "collision.h"
+#include "clothSim.h"
+#include "model.h"
+
+#include <cmath>
+#include <cstdio>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+using namespace std;
+
+Collider::Collider(){
+    position = glm::vec3(0,0,0);
+    thickness = 0.0f;
+    boundsMin = glm::vec3(0,0,0);
+    boundsMax = glm::vec3(0,0,0);
+}
+
+//Closest point to p on triangle abc (Ericson, Real-Time Collision Detection 5.1.5)
+static glm::vec3 closestOnTriangle(glm::vec3 p, glm::vec3 a, glm::vec3 b, glm::vec3 c){
+    glm::vec3 ab = b - a, ac = c - a, ap = p - a;
+    float d1 = dot(ab,ap), d2 = dot(ac,ap);
+    if (d1 <= 0.0f && d2 <= 0.0f) return a;
+    glm::vec3 bp = p - b;
+    float d3 = dot(ab,bp), d4 = dot(ac,bp);
+    if (d3 >= 0.0f && d4 <= d3) return b;
+    float vc = d1*d4 - d3*d2;
+    if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) return a + (d1/(d1 - d3))*ab;
+    glm::vec3 cp = p - c;
+    float d5 = dot(ab,cp), d6 = dot(ac,cp);
+    if (d6 >= 0.0f && d5 <= d6) return c;
+    float vb = d5*d2 - d1*d6;
+    if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) return a + (d2/(d2 - d6))*ac;
+    float va = d3*d6 - d5*d4;
+    if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f){
+        return b + ((d4 - d3)/((d4 - d3) + (d5 - d6)))*(c - b);
+    }
+    float denom = 1.0f/(va + vb + vc);
+    return a + (vb*denom)*ab + (vc*denom)*ac;
+}
+
+//Squared distance from p to the box lo..hi, 0 inside
+static float boxDistance2(glm::vec3 p, glm::vec3 lo, glm::vec3 hi){
+    float d2 = 0.0f;
+    for (int axis = 0; axis < 3; axis++){
+        float d = max(max(lo[axis] - p[axis], p[axis] - hi[axis]), 0.0f);
+        d2 += d*d;
+    }
+    return d2;
+}
+
+SphereCollider::SphereCollider(float _radius, float _thickness){
+    radius = _radius;
+    thickness = _thickness;
+    boundsMin = glm::vec3(-radius,-radius,-radius);
+    boundsMax = glm::vec3(radius,radius,radius);
+}
+
+bool SphereCollider::query(glm::vec3 p, float maxDistance, float& distance, glm::vec3& normal) const{
+    glm::vec3 d = p - position;
+    float length = sqrt(dot(d,d));
+    distance = length - radius;
+    if (distance > maxDistance) return false;
+    normal = length > 1e-6f ? d*(1.0f/length) : glm::vec3(0,1,0);
+    return true;
+}
+
+CapsuleCollider::CapsuleCollider(glm::vec3 _a, glm::vec3 _b, float _radius, float _thickness){
+    a = _a;
+    b = _b;
+    radius = _radius;
+    thickness = _thickness;
+    for (int axis = 0; axis < 3; axis++){
+        boundsMin[axis] = min(a[axis], b[axis]) - radius;
+        boundsMax[axis] = max(a[axis], b[axis]) + radius;
+    }
+}
+
+bool CapsuleCollider::query(glm::vec3 p, float maxDistance, float& distance, glm::vec3& normal) const{
+    p = p - position;
+    glm::vec3 axis = b - a;
+    float length2 = dot(axis,axis);
+    float t = length2 > 0.0f ? min(max(dot(p - a, axis)/length2, 0.0f), 1.0f) : 0.0f;
+    glm::vec3 d = p - (a + t*axis);
+    float length = sqrt(dot(d,d));
+    distance = length - radius;
+    if (distance > maxDistance) return false;
+    normal = length > 1e-6f ? d*(1.0f/length) : glm::vec3(0,1,0);
+    return true;
+}
+
+BoxCollider::BoxCollider(glm::vec3 _halfExtents, float _thickness){
+    halfExtents = _halfExtents;
+    thickness = _thickness;
+    boundsMin = -1.0f*halfExtents;
+    boundsMax = halfExtents;
+}
+
+bool BoxCollider::query(glm::vec3 p, float maxDistance, float& distance, glm::vec3& normal) const{
+    p = p - position;
+    //per axis distance outside each face pair, negative inside
+    glm::vec3 q(fabs(p[0]) - halfExtents[0], fabs(p[1]) - halfExtents[1], fabs(p[2]) - halfExtents[2]);
+    glm::vec3 outside(max(q[0],0.0f), max(q[1],0.0f), max(q[2],0.0f));
+    float outsideLength = sqrt(dot(outside,outside));
+    if (outsideLength > 0.0f){
+        distance = outsideLength;
+        if (distance > maxDistance) return false;
+        for (int axis = 0; axis < 3; axis++) normal[axis] = p[axis] < 0.0f ? -outside[axis] : outside[axis];
+        normal = normal*(1.0f/outsideLength);
+        return true;
+    }
+    //inside, out through the nearest face
+    int axis = 0;
+    if (q[1] > q[axis]) axis = 1;
+    if (q[2] > q[axis]) axis = 2;
+    distance = q[axis];
+    normal = glm::vec3(0,0,0);
+    normal[axis] = p[axis] < 0.0f ? -1.0f : 1.0f;
+    return true;
+}
+
+bool loadScene(const char* path, float thickness, vector<Collider*>& colliders){
+    ifstream file(path);
+    if (!file){
+        printf("Error: could not read scene %s\n", path);
+        return false;
+    }
+    string line;
+    int lineNumber = 0;
+    while (getline(file, line)){
+        lineNumber++;
+        istringstream words(line);
+        string shape;
+        if (!(words >> shape) || shape[0] == '#') continue;
+        float v[7];
+        int count = shape == "sphere" ? 4 : shape == "capsule" ? 7 : shape == "box" ? 6 : 0;
+        int read = 0;
+        while (read < count && words >> v[read]) read++;
+        if (count == 0 || read < count){
+            printf("Error: scene %s line %d is not a sphere, capsule or box\n", path, lineNumber);
+            return false;
+        }
+        Collider* collider;
+        if (shape == "sphere"){
+            collider = new SphereCollider(v[3], thickness);
+            collider->position = glm::vec3(v[0],v[1],v[2]);
+        }
+        else if (shape == "capsule"){
+            glm::vec3 a(v[0],v[1],v[2]), b(v[3],v[4],v[5]);
+            glm::vec3 center = .5f*(a + b);
+            collider = new CapsuleCollider(a - center, b - center, v[6], thickness);
+            collider->position = center;
+        }
+        else{
+            collider = new BoxCollider(glm::vec3(v[3],v[4],v[5]), thickness);
+            collider->position = glm::vec3(v[0],v[1],v[2]);
+        }
+        colliders.push_back(collider);
+    }
+    return true;
+}
+
+ObstacleGrid::ObstacleGrid(){
+    origin = glm::vec3(0,0,0);
+    cellSize = 1.0f;
+    dims[0] = dims[1] = dims[2] = 0;
+}
+
+//Cells covering lo..hi, clamped to the grid, false when the box misses it
+bool ObstacleGrid::cellRange(glm::vec3 lo, glm::vec3 hi, int* range) const{
+    for (int axis = 0; axis < 3; axis++){
+        float first = (lo[axis] - origin[axis])/cellSize, last = (hi[axis] - origin[axis])/cellSize;
+        if (!(last >= 0.0f && first < dims[axis])) return false;
+        range[axis] = max((int)first, 0);
+        range[axis+3] = min((int)last, dims[axis] - 1);
+    }
+    return true;
+}
+
+void ObstacleGrid::build(const vector<Collider*>& colliders){
+    int count = (int)colliders.size();
+    vector<glm::vec3> lo(count), hi(count);
+    vector<float> extents(count);
+    glm::vec3 sceneMin(0,0,0), sceneMax(0,0,0);
+    for (int c = 0; c < count; c++){
+        const Collider& collider = *colliders[c];
+        glm::vec3 grow(collider.thickness, collider.thickness, collider.thickness);
+        lo[c] = collider.position + collider.boundsMin - grow;
+        hi[c] = collider.position + collider.boundsMax + grow;
+        glm::vec3 size = hi[c] - lo[c];
+        extents[c] = max(size[0], max(size[1], size[2]));
+        for (int axis = 0; axis < 3; axis++){
+            sceneMin[axis] = c == 0 ? lo[c][axis] : min(sceneMin[axis], lo[c][axis]);
+            sceneMax[axis] = c == 0 ? hi[c][axis] : max(sceneMax[axis], hi[c][axis]);
+        }
+    }
+    //cells the size of a typical obstacle, so most overlap a handful of cells, but no more
+    //than 64 along the longest side of the scene
+    glm::vec3 sceneSize = sceneMax - sceneMin;
+    float longest = max(sceneSize[0], max(sceneSize[1], sceneSize[2]));
+    if (count > 0){
+        nth_element(extents.begin(), extents.begin() + count/2, extents.end());
+        cellSize = max(extents[count/2], longest/64.0f);
+    }
+    if (!(cellSize > 0.0f && cellSize < 1e6f)) cellSize = 1.0f;
+    origin = sceneMin;
+    for (int axis = 0; axis < 3; axis++){
+        dims[axis] = count > 0 ? min((int)(sceneSize[axis]/cellSize) + 1, 64) : 0;
+    }
+    int cells = dims[0]*dims[1]*dims[2];
+    start.assign(cells + 1, 0);
+    //counting sort, colliders stay in index order within a cell
+    int range[6];
+    for (int pass = 0; pass < 2; pass++){
+        vector<int> next(start.begin(), start.end() - 1);
+        for (int c = 0; c < count; c++){
+            if (!cellRange(lo[c], hi[c], range)) continue;
+            for (int z = range[2]; z <= range[5]; z++)
+                for (int y = range[1]; y <= range[4]; y++)
+                    for (int x = range[0]; x <= range[3]; x++){
+                        int cell = (z*dims[1] + y)*dims[0] + x;
+                        if (pass == 0) start[cell + 1]++;
+                        else entries[next[cell]++] = c;
+                    }
+        }
+        if (pass == 0){
+            for (int cell = 0; cell < cells; cell++) start[cell+1] += start[cell];
+            entries.resize(start[cells]);
+        }
+    }
+}
+
+const int* ObstacleGrid::cell(glm::vec3 p, int& count) const{
+    int c[3];
+    for (int axis = 0; axis < 3; axis++){
+        float g = (p[axis] - origin[axis])/cellSize;
+        if (!(g >= 0.0f && g < dims[axis])){
+            count = 0;
+            return NULL;
+        }
+        c[axis] = (int)g;
+    }
+    int index = (c[2]*dims[1] + c[1])*dims[0] + c[0];
+    count = start[index+1] - start[index];
+    return count > 0 ? &entries[start[index]] : NULL;
+}
+
+void ObstacleGrid::gather(glm::vec3 lo, glm::vec3 hi, vector<int>& found) const{
+    found.clear();
+    int range[6];
+    if (!cellRange(lo, hi, range)) return;
+    for (int z = range[2]; z <= range[5]; z++)
+        for (int y = range[1]; y <= range[4]; y++)
+            for (int x = range[0]; x <= range[3]; x++){
+                int cell = (z*dims[1] + y)*dims[0] + x;
+                found.insert(found.end(), entries.begin() + start[cell], entries.begin() + start[cell+1]);
+            }
+    sort(found.begin(), found.end());
+    found.erase(unique(found.begin(), found.end()), found.end());
+}
+
+MeshCollider::MeshCollider(const Model& model, float _thickness){
+    thickness = _thickness;
+    int count = model.triangleCount();
+    vertices.resize(model.vertexCount());
+    for (int v = 0; v < model.vertexCount(); v++){
+        const float* p = model.vertex(v);
+        vertices[v] = glm::vec3(p[0],p[1],p[2]);
+    }
+    vector<glm::vec3> inNormals(count);
+    vector<glm::vec3> centroids(count);
+    for (int t = 0; t < count; t++){
+        glm::vec3 vertexNormals(0,0,0);
+        for (int c = 0; c < 3; c++){
+            const float* v = model.corner(t, c);
+            vertexNormals += glm::vec3(v[5],v[6],v[7]);
+        }
+        const unsigned* index = model.indices + 3*t;
+        glm::vec3 a = vertices[index[0]], b = vertices[index[1]], c = vertices[index[2]];
+        glm::vec3 n = cross(b - a, c - a);
+        if (dot(n,n) == 0.0f) n = vertexNormals;
+        //the winding is not consistent across models, the vertex normals point out
+        if (dot(n,vertexNormals) < 0.0f) n = -1.0f*n;
+        inNormals[t] = dot(n,n) > 0.0f ? normalize(n) : glm::vec3(0,1,0);
+        centroids[t] = (a + b + c)/3.0f;
+    }
+    //build over an index permutation, then store the triangles in leaf order
+    order.resize(count);
+    for (int t = 0; t < count; t++) order[t] = t;
+    nodes.clear();
+    if (count > 0) build(0, count, centroids);
+    triangles.resize(3*count);
+    faceNormals.resize(count);
+    for (int t = 0; t < count; t++){
+        for (int c = 0; c < 3; c++) triangles[3*t + c] = model.indices[3*order[t] + c];
+        faceNormals[t] = inNormals[order[t]];
+    }
+    order.clear();
+    refit();
+}
+
+//Split triangles first..end of order at the centroid median of the longest axis
+int MeshCollider::build(int first, int end, vector<glm::vec3>& centroids){
+    int index = (int)nodes.size();
+    nodes.push_back(Node());
+    glm::vec3 lo = centroids[order[first]], hi = lo;
+    for (int t = first; t < end; t++){
+        for (int axis = 0; axis < 3; axis++){
+            lo[axis] = min(lo[axis], centroids[order[t]][axis]);
+            hi[axis] = max(hi[axis], centroids[order[t]][axis]);
+        }
+    }
+    if (end - first <= 4){
+        nodes[index].start = first;
+        nodes[index].count = end - first;
+        return index;
+    }
+    int axis = 0;
+    glm::vec3 extent = hi - lo;
+    if (extent[1] > extent[axis]) axis = 1;
+    if (extent[2] > extent[axis]) axis = 2;
+    int mid = (first + end)/2;
+    nth_element(order.begin() + first, order.begin() + mid, order.begin() + end, [&](int a, int b){
+        return centroids[a][axis] < centroids[b][axis];
+    });
+    build(first, mid, centroids);
+    int right = build(mid, end, centroids);
+    nodes[index].start = right;
+    nodes[index].count = 0;
+    return index;
+}
+
+//Recompute every box bottom up from the triangles, children always come after their parent
+void MeshCollider::refit(){
+    for (int i = (int)nodes.size() - 1; i >= 0; i--){
+        Node& node = nodes[i];
+        if (node.count > 0){
+            node.lo = node.hi = vertices[triangles[3*node.start]];
+            for (int c = 3*node.start; c < 3*(node.start + node.count); c++){
+                glm::vec3 v = vertices[triangles[c]];
+                for (int axis = 0; axis < 3; axis++){
+                    node.lo[axis] = min(node.lo[axis], v[axis]);
+                    node.hi[axis] = max(node.hi[axis], v[axis]);
+                }
+            }
+        }
+        else{
+            const Node& left = nodes[i+1];
+            const Node& right = nodes[node.start];
+            for (int axis = 0; axis < 3; axis++){
+                node.lo[axis] = min(left.lo[axis], right.lo[axis]);
+                node.hi[axis] = max(left.hi[axis], right.hi[axis]);
+            }
+        }
+    }
+    if (!nodes.empty()){
+        boundsMin = nodes[0].lo;
+        boundsMax = nodes[0].hi;
+    }
+}
+
+bool MeshCollider::query(glm::vec3 p, float maxDistance, float& distance, glm::vec3& normal) const{
+    if (nodes.empty()) return false;
+    p = p - position;
+    float best = maxDistance*maxDistance;
+    int bestTriangle = -1;
+    glm::vec3 bestPoint;
+    int stack[64];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0){
+        const Node& node = nodes[stack[--top]];
+        if (boxDistance2(p, node.lo, node.hi) > best) continue;
+        if (node.count > 0){
+            for (int t = node.start; t < node.start + node.count; t++){
+                glm::vec3 q = closestOnTriangle(p, corner(t,0), corner(t,1), corner(t,2));
+                glm::vec3 d = p - q;
+                if (dot(d,d) < best){
+                    best = dot(d,d);
+                    bestTriangle = t;
+                    bestPoint = q;
+                }
+            }
+            continue;
+        }
+        //visit the nearer child first so the far one is usually pruned
+        int left = &node - &nodes[0] + 1, right = node.start;
+        float dl = boxDistance2(p, nodes[left].lo, nodes[left].hi);
+        float dr = boxDistance2(p, nodes[right].lo, nodes[right].hi);
+        if (dl < dr) swap(left, right);
+        stack[top++] = left;
+        stack[top++] = right;
+    }
+    if (bestTriangle < 0) return false;
+    glm::vec3 faceNormal = faceNormals[bestTriangle];
+    glm::vec3 d = p - bestPoint;
+    float length = sqrt(dot(d,d));
+    bool inside = dot(d,faceNormal) < 0.0f;
+    distance = inside ? -length : length;
+    if (length > 1e-6f) normal = inside ? d*(-1.0f/length) : d*(1.0f/length);
+    else normal = faceNormal;
+    return true;
+}
+
+void buildObstacleGrid(Cloth& cloth, const SimParams& params){
+    if (cloth.obstacleGrid == NULL){
+        cloth.obstacleGrid = new ObstacleGrid();
+    }
+    cloth.obstacleGrid->build(params.colliders);
+}
+
+void collideRow(Cloth& cloth, const SimParams& params, int i, float dt){
+    if (params.colliders.empty() || (i == 0 && !params.drop)) return;
+    Vec3Array& pos = cloth.pos;
+    Vec3Array& vel = cloth.vel;
+    const ObstacleGrid& grid = *cloth.obstacleGrid;
+    for (int k = cloth.index(i,0); k < cloth.index(i+1,0); k++){
+        if (pos.y[k] - (-2.0) < .02f) continue;
+        //only the colliders whose grown bounds reach the particle's cell can be within their thickness of it
+        int count;
+        const int* candidates = grid.cell(pos.get(k), count);
+        if (count == 0) continue;
+        //search as far as the particle moved this step, so one that went that deep inside is still pushed out
+        glm::vec3 v = vel.get(k);
+        float travel = sqrt(dot(v,v))*dt;
+        for (int c = 0; c < count; c++){
+            const Collider& collider = *params.colliders[candidates[c]];
+            glm::vec3 local = pos.get(k) - collider.position;
+            float reach = collider.thickness + travel;
+            if (boxDistance2(local, collider.boundsMin, collider.boundsMax) > reach*reach) continue;
+            float distance;
+            glm::vec3 normal;
+            if (!collider.query(pos.get(k), reach, distance, normal) || distance >= collider.thickness) continue;
+            pos.add(k, (collider.thickness - distance)*normal);
+            float inward = dot(vel.get(k),normal);
+            if (inward < 0.0f) vel.sub(k, inward*normal);
+        }
+    }
+}
+
+void collideObstacles(Cloth& cloth, const SimParams& params, float dt){
+    if (params.colliders.empty()) return;
+    buildObstacleGrid(cloth, params);
+    forEachRow(0, cloth.n, 1, [&](int i){ collideRow(cloth, params, i, dt); });
+}
+
+SdfCollider::SdfCollider(){
+    origin = glm::vec3(0,0,0);
+    cell = band = 0.0f;
+    dims[0] = dims[1] = dims[2] = 0;
+    fromCache = false;
+}
+
+void SdfCollider::build(const MeshCollider& mesh, float _cell, float _band){
+    cell = _cell;
+    band = _band;
+    boundsMin = mesh.boundsMin;
+    boundsMax = mesh.boundsMax;
+    //one extra cell of margin keeps the outer samples beyond the band
+    float margin = band + cell;
+    origin = boundsMin - glm::vec3(margin,margin,margin);
+    for (int axis = 0; axis < 3; axis++){
+        dims[axis] = (int)ceil((boundsMax[axis] - boundsMin[axis] + 2*margin)/cell) + 1;
+    }
+    int sx = dims[0], sy = dims[1], sz = dims[2];
+    values.assign(sx*sy*sz, band);
+    vector<char> near(sx*sy*sz, 0);
+    forEachRow(0, sz, 1, [&](int z){
+        for (int y = 0; y < sy; y++){
+            for (int x = 0; x < sx; x++){
+                glm::vec3 p = mesh.position + origin + cell*glm::vec3(x,y,z);
+                float distance;
+                glm::vec3 normal;
+                int s = (z*sy + y)*sx + x;
+                if (mesh.query(p, band, distance, normal)){
+                    values[s] = distance;
+                    near[s] = 1;
+                }
+            }
+        }
+    });
+    //samples beyond the band take their sign from a flood fill: the ones reachable from the
+    //grid border without crossing the band are outside, the rest are enclosed by the surface
+    vector<char> outside(sx*sy*sz, 0);
+    vector<int> stack;
+    for (int z = 0; z < sz; z++){
+        for (int y = 0; y < sy; y++){
+            for (int x = 0; x < sx; x++){
+                bool border = x == 0 || y == 0 || z == 0 || x == sx-1 || y == sy-1 || z == sz-1;
+                int s = (z*sy + y)*sx + x;
+                if (border && !near[s]){
+                    outside[s] = 1;
+                    stack.push_back(s);
+                }
+            }
+        }
+    }
+    const int offsets[6] = {1, -1, sx, -sx, sx*sy, -sx*sy};
+    while (!stack.empty()){
+        int s = stack.back();
+        stack.pop_back();
+        int x = s % sx, y = (s/sx) % sy, z = s/(sx*sy);
+        bool inGrid[6] = {x < sx-1, x > 0, y < sy-1, y > 0, z < sz-1, z > 0};
+        for (int d = 0; d < 6; d++){
+            int t = s + offsets[d];
+            if (inGrid[d] && !near[t] && !outside[t]){
+                outside[t] = 1;
+                stack.push_back(t);
+            }
+        }
+    }
+    for (int s = 0; s < sx*sy*sz; s++){
+        if (!near[s] && !outside[s]) values[s] = -band;
+    }
+    fromCache = false;
+}
+
+bool SdfCollider::query(glm::vec3 p, float maxDistance, float& distance, glm::vec3& normal) const{
+    glm::vec3 g = (p - position - origin)*(1.0f/cell);
+    int c[3];
+    float f[3];
+    for (int axis = 0; axis < 3; axis++){
+        if (!(g[axis] >= 0.0f && g[axis] < dims[axis] - 1)) return false;
+        c[axis] = (int)g[axis];
+        f[axis] = g[axis] - c[axis];
+    }
+    int sx = dims[0], sxy = dims[0]*dims[1];
+    const float* v = &values[c[2]*sxy + c[1]*sx + c[0]];
+    float v000 = v[0], v100 = v[1], v010 = v[sx], v110 = v[sx+1];
+    float v001 = v[sxy], v101 = v[sxy+1], v011 = v[sxy+sx], v111 = v[sxy+sx+1];
+    //interpolate along x, then y, then z, differentiating each stage for the gradient
+    float v00 = v000 + f[0]*(v100 - v000), v10 = v010 + f[0]*(v110 - v010);
+    float v01 = v001 + f[0]*(v101 - v001), v11 = v011 + f[0]*(v111 - v011);
+    float v0 = v00 + f[1]*(v10 - v00), v1 = v01 + f[1]*(v11 - v01);
+    distance = v0 + f[2]*(v1 - v0);
+    if (distance > maxDistance) return false;
+    float dx00 = v100 - v000, dx10 = v110 - v010, dx01 = v101 - v001, dx11 = v111 - v011;
+    float dx0 = dx00 + f[1]*(dx10 - dx00), dx1 = dx01 + f[1]*(dx11 - dx01);
+    float dy0 = v10 - v00, dy1 = v11 - v01;
+    glm::vec3 gradient(dx0 + f[2]*(dx1 - dx0), dy0 + f[2]*(dy1 - dy0), v1 - v0);
+    float length = sqrt(dot(gradient,gradient));
+    //deeper than the band the field is flat and has no direction to push along
+    if (length < 1e-6f) return false;
+    normal = gradient*(1.0f/length);
+    return true;
+}
+
+//Written next to path and renamed over it, so a reader never sees a half written cache
+bool SdfCollider::save(const char* path, unsigned key) const{
+    string tempPath = string(path) + ".tmp";
+    ofstream file(tempPath.c_str(), ios::binary);
+    if (!file) return false;
+    file.write("SDF1", 4);
+    file.write((const char*)&key, sizeof(key));
+    file.write((const char*)&cell, sizeof(cell));
+    file.write((const char*)&band, sizeof(band));
+    file.write((const char*)dims, sizeof(dims));
+    file.write((const char*)&origin[0], 3*sizeof(float));
+    file.write((const char*)&boundsMin[0], 3*sizeof(float));
+    file.write((const char*)&boundsMax[0], 3*sizeof(float));
+    file.write((const char*)&values[0], values.size()*sizeof(float));
+    file.close();
+    if (!file || rename(tempPath.c_str(), path) != 0){
+        remove(tempPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool SdfCollider::load(const char* path, unsigned key, float _cell, float _band){
+    ifstream file(path, ios::binary);
+    if (!file) return false;
+    char magic[4];
+    unsigned fileKey;
+    float fileCell, fileBand;
+    int fileDims[3];
+    file.read(magic, 4);
+    file.read((char*)&fileKey, sizeof(fileKey));
+    file.read((char*)&fileCell, sizeof(fileCell));
+    file.read((char*)&fileBand, sizeof(fileBand));
+    file.read((char*)fileDims, sizeof(fileDims));
+    if (!file || string(magic, 4) != "SDF1" || fileKey != key || fileCell != _cell || fileBand != _band) return false;
+    for (int axis = 0; axis < 3; axis++){
+        if (fileDims[axis] < 2 || fileDims[axis] > 4096) return false;
+    }
+    glm::vec3 fileOrigin, fileMin, fileMax;
+    file.read((char*)&fileOrigin[0], 3*sizeof(float));
+    file.read((char*)&fileMin[0], 3*sizeof(float));
+    file.read((char*)&fileMax[0], 3*sizeof(float));
+    vector<float> fileValues((size_t)fileDims[0]*fileDims[1]*fileDims[2]);
+    file.read((char*)&fileValues[0], fileValues.size()*sizeof(float));
+    if (!file) return false;
+    cell = fileCell;
+    band = fileBand;
+    for (int axis = 0; axis < 3; axis++) dims[axis] = fileDims[axis];
+    origin = fileOrigin;
+    boundsMin = fileMin;
+    boundsMax = fileMax;
+    values.swap(fileValues);
+    fromCache = true;
+    return true;
+}
+
+SdfCollider* loadSdfCollider(const Model& model, float thickness, float cell, const char* cachePath){
+    SdfCollider* sdf = new SdfCollider();
+    sdf->thickness = thickness;
+    //wide enough for the thickness plus a few cells of travel per step
+    float band = thickness + 4*cell;
+    unsigned key = model.checksum;
+    if (cachePath != NULL && sdf->load(cachePath, key, cell, band)) return sdf;
+    MeshCollider mesh(model, thickness);
+    if (mesh.triangleCount() == 0){
+        delete sdf;
+        return NULL;
+    }
+    sdf->build(mesh, cell, band);
+    if (cachePath != NULL && !sdf->save(cachePath, key)){
+        printf("Warning: could not write distance field cache %s\n", cachePath);
+    }
+    return sdf;
+}
+
+SweepState::SweepState(int n){
+    prevPos.allocate(n*n);
+    sphereCenter = glm::vec3(0,0,0);
+    hits = 0;
+}
+
+SweepState::~SweepState(){
+    prevPos.release();
+}
+
+void beginSweep(Cloth& cloth, const SimParams& params){
+    if (!params.ccd) return;
+    if (cloth.sweep == NULL){
+        cloth.sweep = new SweepState(cloth.n);
+        cloth.sweep->sphereCenter = params.sphereCenter;
+    }
+    SweepState& sweep = *cloth.sweep;
+    //obstacles that were not there last step did not move
+    if (sweep.colliders != params.colliders){
+        sweep.colliders = params.colliders;
+        sweep.colliderPositions.resize(params.colliders.size());
+        for (size_t c = 0; c < params.colliders.size(); c++) sweep.colliderPositions[c] = params.colliders[c]->position;
+    }
+    forEachRow(0, cloth.n, 1, [&](int i){
+        for (int k = cloth.index(i,0); k < cloth.index(i+1,0); k++) sweep.prevPos.set(k, cloth.pos.get(k));
+    });
+}
+
+//Earliest t in [0,1] where from + t*(to - from) reaches the sphere of radius r at the origin,
+//0 when from is already inside it
+static bool sweepSphere(glm::vec3 from, glm::vec3 to, float r, float& t){
+    glm::vec3 d = to - from;
+    float a = dot(d,d);
+    float b = dot(from,d);
+    float c = dot(from,from) - r*r;
+    if (c <= 0.0f){
+        t = 0.0f;
+        return true;
+    }
+    if (a == 0.0f || b >= 0.0f) return false;
+    float discriminant = b*b - a*c;
+    if (discriminant < 0.0f) return false;
+    t = (-b - sqrt(discriminant))/a;
+    return t <= 1.0f;
+}
+
+//Conservative advancement along from..to (both in the collider's current frame): no surface is
+//closer than the distance at a sample, so stepping that far cannot skip one. Returns the last
+//sample outside the surface, with its distance and normal, when the path reaches the inside.
+static bool sweepCollider(const Collider& collider, glm::vec3 from, glm::vec3 to, glm::vec3& contact, float& distance, glm::vec3& normal){
+    glm::vec3 d = to - from;
+    float length = sqrt(dot(d,d));
+    float t = 0.0f;
+    bool outside = false;
+    for (int iteration = 0; iteration < 32; iteration++){
+        glm::vec3 x = from + (t/length)*d;
+        float sampleDistance;
+        glm::vec3 sampleNormal;
+        if (!collider.query(x, length - t + collider.thickness, sampleDistance, sampleNormal)) return false;
+        if (sampleDistance <= 0.0f){
+            return outside;
+        }
+        outside = true;
+        contact = x;
+        distance = sampleDistance;
+        normal = sampleNormal;
+        //a floor on the step keeps a particle sliding along the surface from stalling
+        t += max(sampleDistance, .25f*collider.thickness);
+        if (t > length) return false;
+    }
+    return false;
+}
+
+void endSweep(Cloth& cloth, const SimParams& params, float dt){
+    if (!params.ccd || cloth.sweep == NULL) return;
+    SweepState& sweep = *cloth.sweep;
+    //collideSphere's radius, paths that only graze it (a particle sliding over it) are left to
+    //collideSphere, the sweep steps in when a path goes deeper than the margin the sphere model
+    //is drawn inside the radius
+    const float sphereRadius = .55f, sphereMargin = .05f;
+    glm::vec3 sphereMotion = params.sphereCenter - sweep.sphereCenter;
+    //a path can only meet the colliders in the cells around it, widened by the furthest any collider moved
+    float maxMotion = 0.0f;
+    if (!params.colliders.empty()){
+        buildObstacleGrid(cloth, params);
+        for (size_t c = 0; c < params.colliders.size(); c++){
+            glm::vec3 motion = params.colliders[c]->position - sweep.colliderPositions[c];
+            maxMotion = max(maxMotion, sqrt(dot(motion,motion)));
+        }
+    }
+    glm::vec3 widen(maxMotion, maxMotion, maxMotion);
+    vector<int> rowHits(cloth.n, 0);
+    forEachRow(0, cloth.n, 1, [&](int i){
+        if (i == 0 && !params.drop) return;
+        vector<int> candidates;
+        for (int k = cloth.index(i,0); k < cloth.index(i+1,0); k++){
+            glm::vec3 from = sweep.prevPos.get(k), to = cloth.pos.get(k);
+            //the path relative to the sphere, which moved in a straight line over the step
+            float t;
+            if (params.sphere && dot(from - sweep.sphereCenter, from - sweep.sphereCenter) > (sphereRadius - sphereMargin)*(sphereRadius - sphereMargin) &&
+                sweepSphere(from - sweep.sphereCenter, to - params.sphereCenter, sphereRadius - sphereMargin, t)){
+                sweepSphere(from - sweep.sphereCenter, to - params.sphereCenter, sphereRadius, t);
+                glm::vec3 hit = (1.0f - t)*(from - sweep.sphereCenter) + t*(to - params.sphereCenter);
+                glm::vec3 n = normalize(hit);
+                cloth.pos.set(k, params.sphereCenter + sphereRadius*n);
+                float inward = dot(cloth.vel.get(k) - sphereMotion/dt, n);
+                if (inward < 0.0f) cloth.vel.sub(k, inward*n);
+                rowHits[i]++;
+                continue;
+            }
+            if (params.colliders.empty()) continue;
+            cloth.obstacleGrid->gather(glm::min(from, to) - widen, glm::max(from, to) + widen, candidates);
+            for (size_t e = 0; e < candidates.size(); e++){
+                int c = candidates[e];
+                const Collider& collider = *params.colliders[c];
+                glm::vec3 motion = collider.position - sweep.colliderPositions[c];
+                //the start point carried along with the obstacle, paths shorter than the thickness
+                //are left to the discrete pass
+                glm::vec3 start = from + motion;
+                glm::vec3 d = to - start;
+                if (dot(d,d) <= collider.thickness*collider.thickness) continue;
+                bool overlaps = true;
+                for (int axis = 0; axis < 3; axis++){
+                    float lo = min(start[axis], to[axis]) - collider.position[axis];
+                    float hi = max(start[axis], to[axis]) - collider.position[axis];
+                    if (hi < collider.boundsMin[axis] - collider.thickness || lo > collider.boundsMax[axis] + collider.thickness) overlaps = false;
+                }
+                if (!overlaps) continue;
+                glm::vec3 contact, normal;
+                float distance;
+                if (!sweepCollider(collider, start, to, contact, distance, normal)) continue;
+                cloth.pos.set(k, contact + max(collider.thickness - distance, 0.0f)*normal);
+                float inward = dot(cloth.vel.get(k) - motion/dt, normal);
+                if (inward < 0.0f) cloth.vel.sub(k, inward*normal);
+                rowHits[i]++;
+                break;
+            }
+        }
+    });
+    for (int i = 0; i < cloth.n; i++) sweep.hits += rowHits[i];
+    sweep.sphereCenter = params.sphereCenter;
+    for (size_t c = 0; c < params.colliders.size(); c++) sweep.colliderPositions[c] = params.colliders[c]->position;
+}
@@ -0,0 +1,160 @@
+#ifndef COLLISION_H
+#define COLLISION_H
+
+#include "clothSim.h"
+
+#include <vector>
+
+class Model;
+
+//Obstacle the cloth collides with besides the built in sphere. Shapes keep their own frame and
+//are placed at position, so moving an obstacle never touches its acceleration structure.
+class Collider{
+public:
+    Collider();
+    virtual ~Collider(){}
+    //Signed distance from p (world space) to the surface and the outward normal there,
+    //false when the surface is further than maxDistance away
+    virtual bool query(glm::vec3 p, float maxDistance, float& distance, glm::vec3& normal) const = 0;
+    glm::vec3 position;
+    //Particles are kept this far outside the surface
+    float thickness;
+    //Local space bounds, particles outside them (plus thickness) skip the query
+    glm::vec3 boundsMin, boundsMax;
+};
+
+//Analytic shapes for scenes with many obstacles, centered on position
+class SphereCollider : public Collider{
+public:
+    SphereCollider(float radius, float thickness);
+    bool query(glm::vec3 p, float maxDistance, float& distance, glm::vec3& normal) const;
+    float radius;
+};
+
+//Segment a..b (relative to position) swept by a sphere of radius
+class CapsuleCollider : public Collider{
+public:
+    CapsuleCollider(glm::vec3 a, glm::vec3 b, float radius, float thickness);
+    bool query(glm::vec3 p, float maxDistance, float& distance, glm::vec3& normal) const;
+    glm::vec3 a, b;
+    float radius;
+};
+
+//Axis aligned box with the given half extents
+class BoxCollider : public Collider{
+public:
+    BoxCollider(glm::vec3 halfExtents, float thickness);
+    bool query(glm::vec3 p, float maxDistance, float& distance, glm::vec3& normal) const;
+    glm::vec3 halfExtents;
+};
+
+//Read a scene of analytic obstacles, one per line:
+//  sphere x y z radius
+//  capsule x1 y1 z1 x2 y2 z2 radius
+//  box x y z halfx halfy halfz
+//blank lines and lines starting with # are skipped. The new obstacles are appended to colliders.
+bool loadScene(const char* path, float thickness, std::vector<Collider*>& colliders);
+
+//Uniform grid broad phase over the colliders' bounds (grown by their thickness), rebuilt every step
+//so obstacles can move. A particle only tests the colliders listed in its cell.
+class ObstacleGrid{
+public:
+    ObstacleGrid();
+    void build(const std::vector<Collider*>& colliders);
+    //Colliders whose grown bounds overlap the cell holding p, count is 0 outside the grid
+    const int* cell(glm::vec3 p, int& count) const;
+    //Colliders overlapping the cells lo..hi touch, each once and in index order
+    void gather(glm::vec3 lo, glm::vec3 hi, std::vector<int>& found) const;
+    glm::vec3 origin;
+    float cellSize;
+    int dims[3];
+    //Cell c lists colliders entries[start[c] .. start[c+1]-1], in index order
+    std::vector<int> start;
+    std::vector<int> entries;
+private:
+    bool cellRange(glm::vec3 lo, glm::vec3 hi, int* range) const;
+};
+
+//Triangle mesh obstacle with a bounding volume hierarchy built when it is created
+class MeshCollider : public Collider{
+public:
+    MeshCollider(const Model& model, float thickness);
+    bool query(glm::vec3 p, float maxDistance, float& distance, glm::vec3& normal) const;
+    void refit();
+    int triangleCount() const { return (int)faceNormals.size(); }
+    glm::vec3 corner(int t, int c) const { return vertices[triangles[3*t + c]]; }
+    //The model's vertex positions and its triangles' indices into them, the triangles ordered so
+    //every leaf covers a contiguous range
+    std::vector<glm::vec3> vertices;
+    std::vector<unsigned> triangles;
+    //Outward normals, oriented by the model's vertex normals
+    std::vector<glm::vec3> faceNormals;
+private:
+    struct Node{
+        glm::vec3 lo, hi;
+        //Leaves hold count triangles from start, inner nodes have count 0, their left child
+        //follows them and the right child is at start
+        int start, count;
+    };
+    int build(int first, int end, std::vector<glm::vec3>& centroids);
+    std::vector<Node> nodes;
+    //Triangle permutation, only used while building
+    std::vector<int> order;
+};
+
+//Static obstacle sampled on a regular grid of signed distances. Samples within band of the surface
+//are exact, further ones are clamped to +-band, so a query is one trilinear lookup and its gradient
+//no matter how many triangles the obstacle has.
+class SdfCollider : public Collider{
+public:
+    SdfCollider();
+    //Sample mesh on cell sized voxels covering its bounds plus band
+    void build(const MeshCollider& mesh, float cell, float band);
+    //Cache files are tagged with key (the model checksum), cell and band, load fails when any differ
+    bool save(const char* path, unsigned key) const;
+    bool load(const char* path, unsigned key, float cell, float band);
+    bool query(glm::vec3 p, float maxDistance, float& distance, glm::vec3& normal) const;
+    int cellCount() const { return dims[0]*dims[1]*dims[2]; }
+    //Local position of sample (0,0,0)
+    glm::vec3 origin;
+    float cell, band;
+    int dims[3];
+    //Sample (x,y,z) is values[(z*dims[1] + y)*dims[0] + x]
+    std::vector<float> values;
+    //Whether load() filled it rather than build()
+    bool fromCache;
+};
+
+//Load the distance field for model from cachePath, or build it from the mesh and write the cache.
+//Returns NULL when the model has no triangles.
+SdfCollider* loadSdfCollider(const Model& model, float thickness, float cell, const char* cachePath);
+
+//Where the particles and obstacles were when the step started, for continuous collision
+class SweepState{
+public:
+    SweepState(int n);
+    ~SweepState();
+    Vec3Array prevPos;
+    glm::vec3 sphereCenter;
+    //Obstacle positions after the last step, reset when the obstacle list changes
+    std::vector<Collider*> colliders;
+    std::vector<glm::vec3> colliderPositions;
+    //Particles the sweep has caught, for reporting
+    long long hits;
+};
+
+//Continuous collision, on when params.ccd is set. beginSweep records the particles before a step,
+//endSweep follows each particle's path over the step against the sphere and colliders as they
+//moved since the last step, and stops it at the first surface it crossed that the discrete tests missed.
+void beginSweep(Cloth& cloth, const SimParams& params);
+void endSweep(Cloth& cloth, const SimParams& params, float dt);
+
+//Rebuild cloth.obstacleGrid for the colliders where they are now
+void buildObstacleGrid(Cloth& cloth, const SimParams& params);
+//Push particles of row i out of every collider in params and stop their motion into it,
+//dt is the step that just moved them. Needs an up to date buildObstacleGrid.
+void collideRow(Cloth& cloth, const SimParams& params, int i, float dt);
+//The same for all rows, one batched pass per step
+void collideObstacles(Cloth& cloth, const SimParams& params, float dt);
+
+#endif
@@ -0,0 +1,288 @@
+//Headless cloth simulation for batch jobs and benchmarks. Links only the simulation code:
+//  g++ -O2 -std=c++11 -pthread headless.cpp clothSim.cpp implicitSolver.cpp xpbdSolver.cpp projectiveSolver.cpp
+//  collision.cpp selfCollision.cpp model.cpp springKernels.cpp threadPool.cpp checks.cpp -o clothHeadless
+//clothHeadless -check runs the self checks in checks.cpp and exits nonzero when one fails
+
+#include "clothSim.h"
+#include "implicitSolver.h"
+#include "projectiveSolver.h"
+#include "selfCollision.h"
+#include "collision.h"
+#include "model.h"
+#include "checks.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <chrono>
+#include <vector>
+using namespace std;
+
+static void usage(){
+    printf("usage: clothHeadless [-n size] [-steps count] [-dt seconds] [-integrator name]\n"
+           "                     (euler, midpoint, implicit, xpbd or projective)\n"
+           "                     [-cgiterations count] [-iterations count] [-compliance value]\n"
+           "                     [-adaptive tolerance] [-sleep energy] [-ks value] [-kd value] [-wind value] [-drop]\n"
+           "                     [-obstacle models/name.txt|.obj|.ply] [-sdf cellsize] [-scene scenes/name.txt]\n"
+           "                     [-self thickness] [-ccd] [-threads count] [-kernel scalar|sse|avx2]\n"
+           "                     [-tiled] [-bench] [-ensemble count] [-check]\n"
+           "-bench runs the euler steps through the three pass update() and the tiled sweep on one thread and compares them\n"
+           "-ensemble steps count cloths together, their wind spread evenly from 0 to the -wind value\n"
+           "-check runs the self checks instead of a simulation\n");
+}
+
+int main(int argc, char *argv[]){
+    
+    //COMMAND LINE
+    SimParams params;
+    int N = 15;
+    int steps = 1000;
+    float dt = 1.0f/60.0f;
+    int numThreads = 1;
+    const char* kernelName = NULL;
+    float tolerance = 0.0f;
+    const char* obstacleName = NULL;
+    float sdfCell = 0.0f;
+    const char* sceneName = NULL;
+    bool bench = false;
+    int ensembleSize = 0;
+    for (int i = 1; i < argc; i++){
+        string arg = argv[i];
+        bool hasValue = i+1 < argc;
+        if (arg == "-n" && hasValue) N = atoi(argv[++i]);
+        else if (arg == "-steps" && hasValue) steps = atoi(argv[++i]);
+        else if (arg == "-dt" && hasValue) dt = atof(argv[++i]);
+        else if (arg == "-cgiterations" && hasValue) params.cgIterations = atoi(argv[++i]);
+        else if (arg == "-iterations" && hasValue) params.solverIterations = atoi(argv[++i]);
+        else if (arg == "-compliance" && hasValue) params.compliance = atof(argv[++i]);
+        else if (arg == "-adaptive" && hasValue) tolerance = atof(argv[++i]);
+        else if (arg == "-sleep" && hasValue) params.sleepEnergy = atof(argv[++i]);
+        else if (arg == "-ks" && hasValue) params.ks = atof(argv[++i]);
+        else if (arg == "-kd" && hasValue) params.kd = atof(argv[++i]);
+        else if (arg == "-wind" && hasValue) params.wind = atof(argv[++i]);
+        else if (arg == "-drop") params.drop = true;
+        else if (arg == "-ccd") params.ccd = true;
+        else if (arg == "-tiled") params.tiled = true;
+        else if (arg == "-bench") bench = true;
+        else if (arg == "-check") return runChecks() ? 0 : 1;
+        else if (arg == "-ensemble" && hasValue) ensembleSize = atoi(argv[++i]);
+        else if (arg == "-threads" && hasValue) numThreads = atoi(argv[++i]);
+        else if (arg == "-kernel" && hasValue) kernelName = argv[++i];
+        else if (arg == "-obstacle" && hasValue) obstacleName = argv[++i];
+        else if (arg == "-scene" && hasValue) sceneName = argv[++i];
+        else if (arg == "-sdf" && hasValue) sdfCell = atof(argv[++i]);
+        else if (arg == "-self" && hasValue) params.selfThickness = atof(argv[++i]);
+        else if (arg == "-integrator" && hasValue){
+            if (!parseIntegrator(argv[++i], params.integrator)){
+                printf("Error: unknown integrator \"%s\"\n", argv[i]); return 1;
+            }
+        }
+        else{
+            usage(); return 1;
+        }
+    }
+    if (N < 2 || steps < 1 || dt <= 0.0f){
+        usage(); return 1;
+    }
+    if (ensembleSize > 0 && (bench || tolerance > 0.0f)){
+        printf("Error: -ensemble steps with a fixed dt, it does not combine with -bench or -adaptive\n"); return 1;
+    }
+    if (tolerance > 0.0f && params.integrator != IMPLICIT){
+        printf("Error: -adaptive grows dt past the explicit stability limit, it needs -integrator implicit\n"); return 1;
+    }
+    if (params.tiled && params.sleepEnergy > 0.0f){
+        printf("Error: -tiled sweeps every row, it does not combine with -sleep\n"); return 1;
+    }
+    if (bench && numThreads > 1){
+        printf("Error: -bench compares both update() paths on one thread, the tiled sweep does not use -threads\n"); return 1;
+    }
+    if (bench && (params.integrator != EULER || params.sleepEnergy > 0.0f || tolerance > 0.0f)){
+        printf("Error: -bench compares update() passes, it needs the euler integrator without -sleep or -adaptive\n"); return 1;
+    }
+    
+    //INITIALIZATION
+    selectSpringKernels(kernelName);
+    if (numThreads > 1){
+        threadPool = new ThreadPool(numThreads);
+    }
+    Collider* obstacle = NULL;
+    MeshCollider* mesh = NULL;
+    SdfCollider* sdf = NULL;
+    string sdfCache;
+    double modelSeconds = 0.0;
+    bool modelCached = false;
+    int modelVertices = 0, modelTriangles = 0;
+    if (obstacleName != NULL){
+        Model model;
+        chrono::steady_clock::time_point loadStart = chrono::steady_clock::now();
+        if (!loadModel(obstacleName, model)) return 1;
+        modelSeconds = chrono::duration<double>(chrono::steady_clock::now() - loadStart).count();
+        modelCached = model.fromCache;
+        modelVertices = model.vertexCount();
+        modelTriangles = model.triangleCount();
+        //models are unit sized like the sphere model, which is drawn .05 inside its collision radius
+        if (sdfCell > 0.0f){
+            sdfCache = string(obstacleName) + ".sdf";
+            obstacle = sdf = loadSdfCollider(model, .05f, sdfCell, sdfCache.c_str());
+            if (sdf == NULL){
+                printf("Error: model %s has no triangles\n", obstacleName); return 1;
+            }
+        }
+        else obstacle = mesh = new MeshCollider(model, .05f);
+        params.sphere = false;
+        params.colliders.push_back(obstacle);
+    }
+    vector<Collider*> scene;
+    if (sceneName != NULL){
+        if (!loadScene(sceneName, .02f, scene)) return 1;
+        params.sphere = false;
+        params.colliders.insert(params.colliders.end(), scene.begin(), scene.end());
+    }
+    Cloth* cloth = new Cloth(N);
+    initializeCloth(*cloth, clothSize/(N-1));
+    
+    //ENSEMBLE
+    if (ensembleSize > 0){
+        Ensemble ensemble(ensembleSize, N);
+        for (int m = 0; m < ensembleSize; m++){
+            ensemble.params[m] = params;
+            ensemble.params[m].wind = ensembleSize > 1 ? params.wind*m/(ensembleSize-1) : params.wind;
+        }
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        for (int s = 0; s < steps; s++){
+            ensemble.step(dt);
+        }
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        printf("ensemble of %d %dx%d cloths, %d steps of %g s, %d thread(s), %s kernel\n", ensembleSize, N, N, steps, dt, numThreads, springKernels.name);
+        printf("time %.3f s, %.3g particle steps/s\n", seconds, (double)ensembleSize*N*N*steps/seconds);
+        for (int m = 0; m < ensembleSize; m++){
+            double center = 0.0;
+            for (int k = 0; k < N*N; k++) center += ensemble.cloths[m]->pos.y[k];
+            printf("  wind %-8g final height: mean %.4f\n", ensemble.params[m].wind, center/(N*N));
+        }
+        delete cloth;
+        delete obstacle;
+        for (size_t c = 0; c < scene.size(); c++) delete scene[c];
+        delete threadPool;
+        return 0;
+    }
+    
+    //BENCHMARK
+    if (bench){
+        //the same steps from the same start, three passes over the grid per step then one tiled sweep
+        Cloth* runs[2];
+        double times[2];
+        for (int tiled = 0; tiled < 2; tiled++){
+            params.tiled = tiled == 1;
+            runs[tiled] = new Cloth(N);
+            initializeCloth(*runs[tiled], clothSize/(N-1));
+            chrono::steady_clock::time_point start = chrono::steady_clock::now();
+            for (int s = 0; s < steps; s++){
+                step(*runs[tiled], params, dt);
+            }
+            times[tiled] = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        }
+        float difference = 0.0f;
+        for (int k = 0; k < N*N; k++){
+            difference = max(difference, glm::length(runs[0]->pos.get(k) - runs[1]->pos.get(k)));
+        }
+        //pos, vel and the two face arrays are streamed by every phase
+        double megabytes = 12.0*sizeof(float)*N*N/1e6;
+        //Modelled, not measured: bytes moved per particle and step once the grid is larger than the
+        //cache, every vec3 read or written is 12 bytes. Three pass: the vertical and the horizontal
+        //springs read pos and read and write vel (36 each), aero reads pos and vel and writes both
+        //face arrays (48), updateRow reads faceAero and reads and writes pos and vel (60). Tiled:
+        //the rows a sweep works on stay in the cache, so pos and vel are read and written once and
+        //the face arrays written once (72).
+        double traffic[2] = {(36.0 + 36.0 + 48.0 + 60.0)*N*N/1e6, 72.0*N*N/1e6};
+        printf("grid %dx%d (%.1f MB of particle and face state), %d steps of %g s, 1 thread, %s kernel\n", N, N, megabytes, steps, dt, springKernels.name);
+        printf("three pass: %.3f s, %.3g particle steps/s, modelled %.2f MB per step (%.1f GB/s)\n",
+               times[0], (double)N*N*steps/times[0], traffic[0], traffic[0]*steps/times[0]/1e3);
+        printf("tiled:      %.3f s, %.3g particle steps/s, modelled %.2f MB per step (%.1f GB/s)\n",
+               times[1], (double)N*N*steps/times[1], traffic[1], traffic[1]*steps/times[1]/1e3);
+        printf("traffic is modelled from bytes per particle, not measured\n");
+        printf("tiled speedup over three pass: %.2fx\n", times[0]/times[1]);
+        printf("largest position difference %g\n", difference);
+        delete runs[0];
+        delete runs[1];
+        delete cloth;
+        delete obstacle;
+        for (size_t c = 0; c < scene.size(); c++) delete scene[c];
+        delete threadPool;
+        return 0;
+    }
+    
+    //RUN
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    AdaptiveStepper stepper(tolerance, dt/64.0f, dt*8.0f);
+    if (tolerance > 0.0f){
+        //cover the same simulated time, steps*dt, with error controlled steps
+        double t = 0.0, duration = (double)steps*dt;
+        while (t < duration){
+            t += stepper.advance(*cloth, params, duration - t);
+        }
+    }
+    else{
+        for (int s = 0; s < steps; s++){
+            step(*cloth, params, dt);
+        }
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    
+    //REPORT
+    double lowest = cloth->pos.y[0], center = 0.0;
+    for (int k = 0; k < N*N; k++){
+        lowest = min(lowest, (double)cloth->pos.y[k]);
+        center += cloth->pos.y[k];
+    }
+    center /= N*N;
+    printf("grid %dx%d, %d steps of %g s, %d thread(s), %s kernel\n", N, N, steps, dt, numThreads, springKernels.name);
+    if (sceneName != NULL){
+        printf("scene %s, %d obstacles\n", sceneName, (int)scene.size());
+    }
+    if (mesh != NULL){
+        printf("obstacle %s, %d triangles\n", obstacleName, mesh->triangleCount());
+    }
+    if (sdf != NULL){
+        printf("obstacle %s, %dx%dx%d distance field %s %s\n", obstacleName, sdf->dims[0], sdf->dims[1], sdf->dims[2],
+               sdf->fromCache ? "loaded from" : "built and cached in", sdfCache.c_str());
+    }
+    if (obstacleName != NULL){
+        printf("model %s in %.2f ms, %d vertices for %d triangles\n", modelCached ? "mapped from its cache" : "parsed and cached",
+               1000*modelSeconds, modelVertices, modelTriangles);
+    }
+    printf("time %.3f s, %.1f steps/s, %.3g particle steps/s\n", seconds, steps/seconds, (double)N*N*steps/seconds);
+    if (tolerance > 0.0f){
+        printf("adaptive: %d steps accepted, %d rejected, %.1f steps per simulated second\n",
+               stepper.accepted, stepper.rejected, stepper.accepted/(steps*dt));
+    }
+    if (cloth->sleep != NULL){
+        SleepState* sleep = cloth->sleep;
+        int asleep = 0;
+        for (int i = 0; i < N; i++) asleep += sleep->asleep[i];
+        printf("sleep: %.1f%% of row updates skipped, %d of %d rows asleep at the end\n",
+               100.0*sleep->rowsSkipped/(sleep->rowsUpdated + sleep->rowsSkipped), asleep, N);
+    }
+    printf("final height: mean %.4f, lowest %.4f\n", center, lowest);
+    if (cloth->implicitSolver != NULL){
+        ImplicitSolver* solver = cloth->implicitSolver;
+        printf("conjugate gradient: %.1f iterations per step\n", solver->totalIterations/(double)solver->solves);
+    }
+    if (cloth->sweep != NULL){
+        printf("continuous collision: %lld particle paths stopped at a surface\n", cloth->sweep->hits);
+    }
+    if (cloth->selfCollision != NULL){
+        printf("self collision: thickness %g, %d particles in contact at the end\n", params.selfThickness, cloth->selfCollision->contacts);
+    }
+    if (cloth->projectiveSolver != NULL){
+        ProjectiveSolver* solver = cloth->projectiveSolver;
+        printf("projective dynamics: %d factorization(s), %lld factor entries (%.1f MB)\n", solver->factorizations,
+               (long long)solver->values.size(), solver->values.size()*(sizeof(double)+sizeof(int))/1e6);
+    }
+    
+    delete cloth;
+    delete obstacle;
+    for (size_t c = 0; c < scene.size(); c++) delete scene[c];
+    delete threadPool;
+    return 0;
+}
@@ -0,0 +1,238 @@
+#include "implicitSolver.h"
+#include "selfCollision.h"
+
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+using namespace std;
+
+ImplicitSolver::ImplicitSolver(int _n){
+    n = _n;
+    vertDir.allocate(n*n);
+    horizDir.allocate(n*n);
+    vertRhs.allocate(n*n);
+    horizRhs.allocate(n*n);
+    vertAlong = allocateFloats(n*n);
+    vertAcross = allocateFloats(n*n);
+    horizAlong = allocateFloats(n*n);
+    horizAcross = allocateFloats(n*n);
+    rhs.allocate(n*n);
+    dv.allocate(n*n);
+    r.allocate(n*n);
+    z.allocate(n*n);
+    p.allocate(n*n);
+    ap.allocate(n*n);
+    precond.allocate(n*n);
+    rowSums = new double[n];
+    totalIterations = 0;
+    solves = 0;
+}
+
+ImplicitSolver::~ImplicitSolver(){
+    vertDir.release(); horizDir.release();
+    vertRhs.release(); horizRhs.release();
+    free(vertAlong); free(vertAcross);
+    free(horizAlong); free(horizAcross);
+    rhs.release(); dv.release(); r.release(); z.release(); p.release(); ap.release();
+    precond.release();
+    delete[] rowSums;
+}
+
+//Linearize spring s between a and b. along/across are the dt*damping + dt^2*stiffness terms
+//parallel and perpendicular to the spring, the perpendicular one is dropped while compressed
+//so the system stays positive definite. rhs gets dt*f - dt^2*K*(va-vb), the part for a.
+static void linearizeSpring(Cloth& cloth, const SimParams& params, int a, int b, float dt,
+                            int s, Vec3Array& dir, Vec3Array& rhs, float* along, float* across){
+    glm::vec3 e = cloth.pos.get(b) - cloth.pos.get(a);
+    float l = sqrt(dot(e,e));
+    e = e * (1.0f/l);
+    float t = max(1.0f - cloth.l0/l, 0.0f);
+    float kdt2 = params.ks*dt*dt;
+    glm::vec3 dvel = cloth.vel.get(a) - cloth.vel.get(b);
+    float f = params.ks*(l - cloth.l0) - params.kd*dot(e,dvel);
+    glm::vec3 kv = kdt2*(t*dvel + (1.0f - t)*dot(e,dvel)*e);
+    dir.set(s, e);
+    along[s] = params.kd*dt + kdt2;
+    across[s] = kdt2*t;
+    rhs.set(s, (f*dt)*e - kv);
+}
+
+//Block of spring s applied to d, along*e*e^T*d + across*(I - e*e^T)*d
+static glm::vec3 springProduct(const Vec3Array& dir, const float* along, const float* across, int s, glm::vec3 d){
+    glm::vec3 e = dir.get(s);
+    return across[s]*d + ((along[s] - across[s])*dot(e,d))*e;
+}
+
+//Diagonal of spring s's block, used by the Jacobi preconditioner
+static glm::vec3 springDiagonal(const Vec3Array& dir, const float* along, const float* across, int s){
+    glm::vec3 e = dir.get(s);
+    return glm::vec3(across[s]) + (along[s] - across[s])*(e*e);
+}
+
+//Particles updateRow will not move, the pinned top row and those resting on the floor
+static bool fixedParticle(Cloth& cloth, const SimParams& params, int i, int k){
+    return (i == 0 && !params.drop) || cloth.pos.y[k] - (-2.0) < .02f;
+}
+
+//y[k] += a*x[k] with the product and sum in double, rounded to float once
+static void addScaled(Vec3Array& y, double a, const Vec3Array& x, int k){
+    y.x[k] = (float)(y.x[k] + a*x.x[k]);
+    y.y[k] = (float)(y.y[k] + a*x.y[k]);
+    y.z[k] = (float)(y.z[k] + a*x.z[k]);
+}
+
+//Sum body(row) over all rows, rows are summed in order so the result does not depend on threads
+static double sumRows(ImplicitSolver& solver, const function<double(int)>& body){
+    forEachRow(0, solver.n, 1, [&](int i){ solver.rowSums[i] = body(i); });
+    double sum = 0.0;
+    for (int i = 0; i < solver.n; i++) sum += solver.rowSums[i];
+    return sum;
+}
+
+//Row i of the system matrix times x, gathered per particle so rows can run in parallel
+void ImplicitSolver::multiplyRow(Cloth& cloth, const SimParams& params, int i, const Vec3Array& x, Vec3Array& out){
+    int N = n;
+    for (int j = 0; j < N; j++){
+        int k = cloth.index(i,j);
+        if (fixedParticle(cloth, params, i, k)){
+            out.set(k, glm::vec3(0,0,0));
+            continue;
+        }
+        glm::vec3 xk = x.get(k);
+        glm::vec3 product = xk;
+        if (i < N-1) product += springProduct(vertDir, vertAlong, vertAcross, k, xk - x.get(k+N));
+        if (i > 0) product += springProduct(vertDir, vertAlong, vertAcross, k-N, xk - x.get(k-N));
+        if (j < N-1) product += springProduct(horizDir, horizAlong, horizAcross, k, xk - x.get(k+1));
+        if (j > 0) product += springProduct(horizDir, horizAlong, horizAcross, k-1, xk - x.get(k-1));
+        out.set(k, product);
+    }
+}
+
+//|rhs - A*dv| / |rhs| of the last solve from the matrix itself, not the CG recurrence. Call it
+//before cloth.pos moves, the fixed particles are read from it. Overwrites ap.
+double ImplicitSolver::residual(Cloth& cloth, const SimParams& params){
+    double rr = sumRows(*this, [&](int i){
+        multiplyRow(cloth, params, i, dv, ap);
+        double sum = 0.0;
+        for (int k = cloth.index(i,0); k < cloth.index(i+1,0); k++){
+            glm::vec3 d = rhs.get(k) - ap.get(k);
+            sum += dot(d,d);
+        }
+        return sum;
+    });
+    double bb = sumRows(*this, [&](int i){
+        double sum = 0.0;
+        for (int k = cloth.index(i,0); k < cloth.index(i+1,0); k++) sum += dot(rhs.get(k),rhs.get(k));
+        return sum;
+    });
+    return bb > 0.0 ? sqrt(rr/bb) : sqrt(rr);
+}
+
+//Solve for the spring velocity change and add it to cloth.vel, returns the CG iterations used
+int ImplicitSolver::solve(Cloth& cloth, const SimParams& params, float dt){
+    int N = n;
+    //linearize every spring, each row owns the springs that start in it
+    forEachRow(0, N, 1, [&](int i){
+        for (int j = 0; j < N; j++){
+            int k = cloth.index(i,j);
+            if (i < N-1) linearizeSpring(cloth, params, k, k+N, dt, k, vertDir, vertRhs, vertAlong, vertAcross);
+            if (j < N-1) linearizeSpring(cloth, params, k, k+1, dt, k, horizDir, horizRhs, horizAlong, horizAcross);
+        }
+    });
+    //gather the right hand side and preconditioner, fixed particles are filtered out
+    forEachRow(0, N, 1, [&](int i){
+        for (int j = 0; j < N; j++){
+            int k = cloth.index(i,j);
+            if (fixedParticle(cloth, params, i, k)){
+                rhs.set(k, glm::vec3(0,0,0));
+                precond.set(k, glm::vec3(1,1,1));
+                continue;
+            }
+            glm::vec3 b(0,0,0);
+            glm::vec3 diag(1,1,1);
+            if (i < N-1){ b += vertRhs.get(k); diag += springDiagonal(vertDir, vertAlong, vertAcross, k); }
+            if (i > 0){ b -= vertRhs.get(k-N); diag += springDiagonal(vertDir, vertAlong, vertAcross, k-N); }
+            if (j < N-1){ b += horizRhs.get(k); diag += springDiagonal(horizDir, horizAlong, horizAcross, k); }
+            if (j > 0){ b -= horizRhs.get(k-1); diag += springDiagonal(horizDir, horizAlong, horizAcross, k-1); }
+            rhs.set(k, b);
+            precond.set(k, 1.0f/diag);
+        }
+    });
+
+    //start from dv = 0, so r = rhs
+    double rz = sumRows(*this, [&](int i){
+        double sum = 0.0;
+        for (int k = cloth.index(i,0); k < cloth.index(i+1,0); k++){
+            glm::vec3 rk = rhs.get(k);
+            glm::vec3 zk = precond.get(k)*rk;
+            dv.set(k, glm::vec3(0,0,0));
+            r.set(k, rk);
+            z.set(k, zk);
+            p.set(k, zk);
+            sum += dot(rk,zk);
+        }
+        return sum;
+    });
+    double rhsNorm = sumRows(*this, [&](int i){
+        double sum = 0.0;
+        for (int k = cloth.index(i,0); k < cloth.index(i+1,0); k++) sum += dot(rhs.get(k),rhs.get(k));
+        return sum;
+    });
+    double threshold = (double)params.cgTolerance*params.cgTolerance*rhsNorm;
+    int iterations = 0;
+    while (iterations < params.cgIterations && rhsNorm > 0.0){
+        iterations++;
+        double pap = sumRows(*this, [&](int i){
+            multiplyRow(cloth, params, i, p, ap);
+            double sum = 0.0;
+            for (int k = cloth.index(i,0); k < cloth.index(i+1,0); k++) sum += dot(p.get(k),ap.get(k));
+            return sum;
+        });
+        if (pap <= 0.0) break;
+        double alpha = rz / pap;
+        double rr = sumRows(*this, [&](int i){
+            double sum = 0.0;
+            for (int k = cloth.index(i,0); k < cloth.index(i+1,0); k++){
+                addScaled(dv, alpha, p, k);
+                addScaled(r, -alpha, ap, k);
+                sum += dot(r.get(k),r.get(k));
+            }
+            return sum;
+        });
+        if (rr <= threshold) break;
+        double rzNew = sumRows(*this, [&](int i){
+            double sum = 0.0;
+            for (int k = cloth.index(i,0); k < cloth.index(i+1,0); k++){
+                glm::vec3 zk = precond.get(k)*r.get(k);
+                z.set(k, zk);
+                sum += dot(r.get(k),zk);
+            }
+            return sum;
+        });
+        double beta = rzNew / rz;
+        rz = rzNew;
+        forEachRow(0, N, 1, [&](int i){
+            for (int k = cloth.index(i,0); k < cloth.index(i+1,0); k++){
+                p.x[k] = (float)(z.x[k] + beta*p.x[k]);
+                p.y[k] = (float)(z.y[k] + beta*p.y[k]);
+                p.z[k] = (float)(z.z[k] + beta*p.z[k]);
+            }
+        });
+    }
+
+    forEachRow(0, N, 1, [&](int i){
+        for (int k = cloth.index(i,0); k < cloth.index(i+1,0); k++) cloth.vel.add(k, dv.get(k));
+    });
+    totalIterations += iterations;
+    solves++;
+    return iterations;
+}
+
+void implicitUpdate(Cloth& cloth, const SimParams& params, float dt){
+    if (cloth.implicitSolver == NULL){
+        cloth.implicitSolver = new ImplicitSolver(cloth.n);
+    }
+    cloth.implicitSolver->solve(cloth, params, dt);
+    integratePositions(cloth, params, dt);
+    collideSelf(cloth, params, NULL);
+}
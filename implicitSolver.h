@@ -0,0 +1,34 @@
+#ifndef IMPLICITSOLVER_H
+#define IMPLICITSOLVER_H
+
+#include "clothSim.h"
+
+//Backward Euler for the structural springs. The linearized system
+//  (I - dt*df/dv - dt^2*df/dx) dv = dt*(f + dt*df/dx*v)
+//is solved with Jacobi preconditioned conjugate gradient without ever building the matrix,
+//each spring only keeps its direction and two stiffness terms.
+class ImplicitSolver{
+public:
+    ImplicitSolver(int n);
+    ~ImplicitSolver();
+    int solve(Cloth& cloth, const SimParams& params, float dt);
+    void multiplyRow(Cloth& cloth, const SimParams& params, int i, const Vec3Array& x, Vec3Array& out);
+    double residual(Cloth& cloth, const SimParams& params);
+    int n;
+    //Vertical spring k joins particles k and k+n, horizontal spring k joins k and k+1
+    Vec3Array vertDir, horizDir;
+    Vec3Array vertRhs, horizRhs;
+    float* vertAlong;
+    float* vertAcross;
+    float* horizAlong;
+    float* horizAcross;
+    //Conjugate gradient vectors, one entry per particle
+    Vec3Array rhs, dv, r, z, p, ap;
+    Vec3Array precond;
+    //Per row partial sums so dot products come out the same for any thread count
+    double* rowSums;
+    int totalIterations;
+    int solves;
+};
+
+#endif
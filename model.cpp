@@ -0,0 +1,524 @@
+#include "model.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <fcntl.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+using namespace std;
+
+//Binary cache layout: this header, then count floats and indexCount indices.
+//The header is 32 bytes so the floats stay aligned.
+struct ModelCacheHeader{
+    char magic[4];
+    unsigned checksum;
+    int count;
+    int indexCount;
+    long long sourceSize;
+    long long sourceTime;
+};
+
+Model::Model(){
+    floats = NULL;
+    count = 0;
+    indices = NULL;
+    indexCount = 0;
+    mapped = NULL;
+    checksum = 0;
+    mappedBytes = 0;
+    fromCache = false;
+}
+
+Model::~Model(){
+    if (mapped != NULL) munmap(mapped, mappedBytes);
+}
+
+static unsigned checksumMesh(const float* floats, int count, const unsigned* indices, int indexCount){
+    unsigned hash = 2166136261u;
+    const unsigned char* bytes = (const unsigned char*)floats;
+    for (size_t b = 0; b < count*sizeof(float); b++){
+        hash = (hash ^ bytes[b])*16777619u;
+    }
+    bytes = (const unsigned char*)indices;
+    for (size_t b = 0; b < indexCount*sizeof(unsigned); b++){
+        hash = (hash ^ bytes[b])*16777619u;
+    }
+    return hash;
+}
+
+//Bit pattern of one 8 float vertex, welding only merges exact copies
+struct VertexKey{
+    unsigned bits[8];
+    bool operator==(const VertexKey& other) const { return memcmp(bits, other.bits, sizeof(bits)) == 0; }
+};
+
+struct VertexKeyHash{
+    size_t operator()(const VertexKey& key) const{
+        unsigned hash = 2166136261u;
+        for (int k = 0; k < 8; k++) hash = (hash ^ key.bits[k])*16777619u;
+        return hash;
+    }
+};
+
+//Fill model with the unique corners of soup (8 floats per corner, 3 corners per triangle),
+//keeping the triangles in order
+static void weldCorners(const vector<float>& soup, Model& model){
+    int corners = (int)soup.size() / 8;
+    unordered_map<VertexKey, unsigned, VertexKeyHash> unique;
+    unique.reserve(corners);
+    model.data.clear();
+    model.indexData.resize(corners);
+    for (int c = 0; c < corners; c++){
+        VertexKey key;
+        for (int k = 0; k < 8; k++){
+            float value = soup[8*c + k] + 0.0f; //-0 and 0 are the same vertex
+            memcpy(&key.bits[k], &value, sizeof(float));
+        }
+        pair<unordered_map<VertexKey, unsigned, VertexKeyHash>::iterator, bool> found =
+            unique.insert(make_pair(key, (unsigned)(model.data.size() / 8)));
+        if (found.second) model.data.insert(model.data.end(), soup.begin() + 8*c, soup.begin() + 8*c + 8);
+        model.indexData[c] = found.first->second;
+    }
+    model.floats = model.data.empty() ? NULL : &model.data[0];
+    model.count = (int)model.data.size();
+    model.indices = model.indexData.empty() ? NULL : &model.indexData[0];
+    model.indexCount = (int)model.indexData.size();
+    model.checksum = modelChecksum(model);
+}
+
+//Area weighted vertex normals for meshes that come without them, 3 floats per position
+static vector<float> smoothNormals(const vector<float>& positions, const vector<int>& triangles){
+    vector<float> normals(positions.size(), 0.0f);
+    for (size_t t = 0; t + 2 < triangles.size(); t += 3){
+        const float* a = &positions[3*triangles[t]];
+        const float* b = &positions[3*triangles[t+1]];
+        const float* c = &positions[3*triangles[t+2]];
+        float e1[3] = {b[0]-a[0], b[1]-a[1], b[2]-a[2]};
+        float e2[3] = {c[0]-a[0], c[1]-a[1], c[2]-a[2]};
+        //the cross product's length is twice the area
+        float n[3] = {e1[1]*e2[2] - e1[2]*e2[1], e1[2]*e2[0] - e1[0]*e2[2], e1[0]*e2[1] - e1[1]*e2[0]};
+        for (int k = 0; k < 3; k++){
+            for (int axis = 0; axis < 3; axis++) normals[3*triangles[t+k] + axis] += n[axis];
+        }
+    }
+    for (size_t v = 0; v < normals.size(); v += 3){
+        float length = sqrt(normals[v]*normals[v] + normals[v+1]*normals[v+1] + normals[v+2]*normals[v+2]);
+        if (length > 0.0f){
+            for (int axis = 0; axis < 3; axis++) normals[v + axis] /= length;
+        }
+        else normals[v+1] = 1.0f;
+    }
+    return normals;
+}
+
+bool loadModelText(const char* path, Model& model){
+    ifstream modelFile;
+    modelFile.open(path);
+    int numLines = 0;
+    if (!(modelFile >> numLines) || numLines < 0 || numLines % 24 != 0){
+        printf("Error: could not read model %s\n", path);
+        return false;
+    }
+    vector<float> soup(numLines);
+    for (int i = 0; i < numLines; i++){
+        if (!(modelFile >> soup[i])){
+            printf("Error: model %s ends after %d of %d floats\n", path, i, numLines);
+            return false;
+        }
+    }
+    modelFile.close();
+    weldCorners(soup, model);
+    return true;
+}
+
+//Read one OBJ face corner, v, v/vt, v//vn or v/vt/vn, into 0 based indices (-1 when missing).
+//Negative indices count back from the last element read so far.
+static bool parseObjCorner(const string& token, const int* sizes, int* corner){
+    const char* s = token.c_str();
+    for (int part = 0; part < 3; part++){
+        corner[part] = -1;
+        if (*s != '/' && *s != '\0'){
+            char* end;
+            long index = strtol(s, &end, 10);
+            if (end == s || index == 0) return false;
+            corner[part] = index > 0 ? index - 1 : sizes[part] + index;
+            if (corner[part] < 0 || corner[part] >= sizes[part]) return false;
+            s = end;
+        }
+        if (*s == '/') s++;
+        else if (*s != '\0') return false;
+    }
+    return corner[0] >= 0;
+}
+
+bool loadModelObj(const char* path, Model& model){
+    ifstream file(path);
+    if (!file){
+        printf("Error: could not read model %s\n", path);
+        return false;
+    }
+    vector<float> positions, texcoords, normals;
+    //3 corners per triangle, each a position, texcoord and normal index
+    vector<int> corners;
+    string line;
+    int lineNumber = 0;
+    while (getline(file, line)){
+        lineNumber++;
+        istringstream in(line);
+        string type;
+        in >> type;
+        bool valid = true;
+        if (type == "v"){
+            float x, y, z;
+            valid = (bool)(in >> x >> y >> z);
+            positions.push_back(x); positions.push_back(y); positions.push_back(z);
+        }
+        else if (type == "vt"){
+            float u, v = 0.0f;
+            valid = (bool)(in >> u);
+            in >> v;
+            texcoords.push_back(u); texcoords.push_back(v);
+        }
+        else if (type == "vn"){
+            float x, y, z;
+            valid = (bool)(in >> x >> y >> z);
+            normals.push_back(x); normals.push_back(y); normals.push_back(z);
+        }
+        else if (type == "f"){
+            int sizes[3] = {(int)positions.size()/3, (int)texcoords.size()/2, (int)normals.size()/3};
+            vector<int> face;
+            string token;
+            while (valid && in >> token){
+                int corner[3];
+                valid = parseObjCorner(token, sizes, corner);
+                face.insert(face.end(), corner, corner + 3);
+            }
+            valid = valid && face.size() >= 9;
+            //polygons become a fan around their first corner
+            for (size_t k = 3; valid && k + 3 < face.size(); k += 3){
+                corners.insert(corners.end(), face.begin(), face.begin() + 3);
+                corners.insert(corners.end(), face.begin() + k, face.begin() + k + 6);
+            }
+        }
+        //groups, materials and smoothing groups do not change the geometry
+        if (!valid){
+            printf("Error: model %s has a bad \"%s\" on line %d\n", path, type.c_str(), lineNumber);
+            return false;
+        }
+    }
+    vector<int> triangles;
+    bool missingNormals = false;
+    for (size_t c = 0; c < corners.size(); c += 3){
+        triangles.push_back(corners[c]);
+        if (corners[c+2] < 0) missingNormals = true;
+    }
+    vector<float> smooth;
+    if (missingNormals) smooth = smoothNormals(positions, triangles);
+    vector<float> soup;
+    soup.reserve(8*triangles.size());
+    for (size_t c = 0; c < corners.size(); c += 3){
+        const float* p = &positions[3*corners[c]];
+        soup.insert(soup.end(), p, p + 3);
+        if (corners[c+1] >= 0) soup.insert(soup.end(), &texcoords[2*corners[c+1]], &texcoords[2*corners[c+1]] + 2);
+        else{ soup.push_back(0.0f); soup.push_back(0.0f); }
+        const float* n = corners[c+2] >= 0 ? &normals[3*corners[c+2]] : &smooth[3*corners[c]];
+        soup.insert(soup.end(), n, n + 3);
+    }
+    weldCorners(soup, model);
+    return true;
+}
+
+//PLY scalar types, indexed by plyTypeNames, each name's size in bytes
+static const char* plyTypeNames[] = {"char","int8","uchar","uint8","short","int16","ushort","uint16",
+                                     "int","int32","uint","uint32","float","float32","double","float64"};
+static const int plyTypeSizes[] = {1,1,1,1,2,2,2,2,4,4,4,4,4,4,8,8};
+//Longest list property read, more is taken for a corrupt count rather than a polygon
+static const int plyMaxList = 64;
+
+static int plyType(const string& name){
+    for (int t = 0; t < 16; t++){
+        if (name == plyTypeNames[t]) return t;
+    }
+    return -1;
+}
+
+//Read one little endian value, false past the end of the data
+static bool readPlyValue(const char*& p, const char* end, int type, double& value){
+    if (end - p < plyTypeSizes[type]) return false;
+    switch (type/2){
+        case 0: { signed char v; memcpy(&v, p, 1); value = v; break; }
+        case 1: { unsigned char v; memcpy(&v, p, 1); value = v; break; }
+        case 2: { short v; memcpy(&v, p, 2); value = v; break; }
+        case 3: { unsigned short v; memcpy(&v, p, 2); value = v; break; }
+        case 4: { int v; memcpy(&v, p, 4); value = v; break; }
+        case 5: { unsigned v; memcpy(&v, p, 4); value = v; break; }
+        case 6: { float v; memcpy(&v, p, 4); value = v; break; }
+        default: { double v; memcpy(&v, p, 8); value = v; break; }
+    }
+    p += plyTypeSizes[type];
+    return true;
+}
+
+static bool plyTruncated(const char* path){
+    printf("Error: model %s ends before its last element\n", path);
+    return false;
+}
+
+struct PlyProperty{
+    string name;
+    int type;
+    //list properties have a count of countType before their values
+    int countType;
+};
+
+struct PlyElement{
+    string name;
+    int count;
+    vector<PlyProperty> properties;
+};
+
+bool loadModelPly(const char* path, Model& model){
+    ifstream file(path, ios::binary);
+    string line;
+    if (!file || !getline(file, line) || line.compare(0, 3, "ply") != 0){
+        printf("Error: could not read model %s\n", path);
+        return false;
+    }
+    vector<PlyElement> elements;
+    bool binary = false;
+    while (getline(file, line)){
+        istringstream in(line);
+        string keyword;
+        in >> keyword;
+        if (keyword == "end_header") break;
+        if (keyword == "format"){
+            string format;
+            in >> format;
+            binary = format == "binary_little_endian";
+        }
+        else if (keyword == "element"){
+            PlyElement element;
+            element.count = -1;
+            in >> element.name >> element.count;
+            if (element.count < 0){
+                printf("Error: model %s has an element without a count\n", path);
+                return false;
+            }
+            elements.push_back(element);
+        }
+        else if (keyword == "property" && !elements.empty()){
+            PlyProperty property;
+            string type;
+            in >> type;
+            property.countType = -1;
+            if (type == "list"){
+                string countType;
+                in >> countType >> type;
+                property.countType = plyType(countType);
+                if (property.countType < 0) type = "";
+            }
+            property.type = plyType(type);
+            in >> property.name;
+            if (property.type < 0){
+                printf("Error: model %s has a property of unknown type\n", path);
+                return false;
+            }
+            elements.back().properties.push_back(property);
+        }
+    }
+    if (!binary){
+        printf("Error: model %s is not a binary little endian PLY\n", path);
+        return false;
+    }
+    //the rest of the file is the element data
+    vector<char> body((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+    const char* p = body.empty() ? NULL : &body[0];
+    const char* end = p + body.size();
+    vector<float> positions, texcoords, normals;
+    vector<int> triangles;
+    bool hasNormals = false, hasTexcoords = false;
+    int vertices = 0;
+    //one list at a time, read into the same buffer
+    vector<int> face;
+    face.reserve(plyMaxList);
+    for (size_t e = 0; e < elements.size(); e++){
+        const PlyElement& element = elements[e];
+        bool isVertex = element.name == "vertex", isFace = element.name == "face";
+        //where each property goes, -1 when it is skipped
+        vector<int> slot(element.properties.size(), -1);
+        for (size_t k = 0; k < element.properties.size(); k++){
+            const string& name = element.properties[k].name;
+            if (isVertex){
+                const char* names[] = {"x","y","z","nx","ny","nz","u","v","s","t","texture_u","texture_v"};
+                for (int n = 0; n < 12; n++){
+                    if (name == names[n]) slot[k] = n < 6 ? n : 6 + n%2;
+                }
+                if (slot[k] >= 3 && slot[k] < 6) hasNormals = true;
+                if (slot[k] >= 6) hasTexcoords = true;
+            }
+            if (isFace && (name == "vertex_indices" || name == "vertex_index")) slot[k] = 0;
+        }
+        //every item takes at least its scalars and list counts, so the data left bounds the count
+        //before anything is stored for it
+        long long itemBytes = 0;
+        for (size_t k = 0; k < element.properties.size(); k++){
+            const PlyProperty& property = element.properties[k];
+            itemBytes += plyTypeSizes[property.countType < 0 ? property.type : property.countType];
+        }
+        if (element.count > 0 && itemBytes == 0){
+            printf("Error: model %s has an element without properties\n", path);
+            return false;
+        }
+        if (element.count > 0 && (end - p)/itemBytes < element.count) return plyTruncated(path);
+        if (isVertex) vertices = element.count;
+        for (int i = 0; i < element.count; i++){
+            double values[8] = {0,0,0,0,0,0,0,0};
+            for (size_t k = 0; k < element.properties.size(); k++){
+                const PlyProperty& property = element.properties[k];
+                double value;
+                if (property.countType < 0){
+                    if (!readPlyValue(p, end, property.type, value)) return plyTruncated(path);
+                    if (slot[k] >= 0) values[slot[k]] = value;
+                    continue;
+                }
+                double listSize;
+                if (!readPlyValue(p, end, property.countType, listSize)) return plyTruncated(path);
+                if (!(listSize >= 0 && listSize <= plyMaxList && listSize == floor(listSize))){
+                    printf("Error: model %s has a list of %g values, at most %d are read\n", path, listSize, plyMaxList);
+                    return false;
+                }
+                if (end - p < (long long)listSize*plyTypeSizes[property.type]) return plyTruncated(path);
+                face.resize((int)listSize);
+                for (size_t v = 0; v < face.size(); v++){
+                    if (!readPlyValue(p, end, property.type, value)) return plyTruncated(path);
+                    face[v] = (int)value;
+                }
+                if (!isFace || slot[k] < 0) continue;
+                for (size_t v = 0; v < face.size(); v++){
+                    if (face[v] < 0 || face[v] >= vertices){
+                        printf("Error: model %s has a face with vertex %d of %d\n", path, face[v], vertices);
+                        return false;
+                    }
+                }
+                //polygons become a fan around their first corner
+                for (size_t v = 1; v + 1 < face.size(); v++){
+                    triangles.push_back(face[0]); triangles.push_back(face[v]); triangles.push_back(face[v+1]);
+                }
+            }
+            if (isVertex){
+                positions.insert(positions.end(), values, values + 3);
+                normals.insert(normals.end(), values + 3, values + 6);
+                texcoords.insert(texcoords.end(), values + 6, values + 8);
+            }
+        }
+    }
+    if (!hasNormals) normals = smoothNormals(positions, triangles);
+    vector<float> soup;
+    soup.reserve(8*triangles.size());
+    for (size_t c = 0; c < triangles.size(); c++){
+        int v = triangles[c];
+        soup.insert(soup.end(), &positions[3*v], &positions[3*v] + 3);
+        if (hasTexcoords) soup.insert(soup.end(), &texcoords[2*v], &texcoords[2*v] + 2);
+        else{ soup.push_back(0.0f); soup.push_back(0.0f); }
+        soup.insert(soup.end(), &normals[3*v], &normals[3*v] + 3);
+    }
+    weldCorners(soup, model);
+    return true;
+}
+
+//Map the cache if it was written from the source file as it is now
+static bool mapModelCache(const string& cachePath, const struct stat& source, Model& model){
+    int fd = open(cachePath.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat cache;
+    if (fstat(fd, &cache) != 0 || (size_t)cache.st_size < sizeof(ModelCacheHeader)){
+        close(fd);
+        return false;
+    }
+    size_t bytes = cache.st_size;
+    void* mapped = mmap(NULL, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) return false;
+    const ModelCacheHeader* header = (const ModelCacheHeader*)mapped;
+    const float* floats = (const float*)(header + 1);
+    const unsigned* indices = (const unsigned*)(floats + header->count);
+    bool valid = memcmp(header->magic, "MDL2", 4) == 0 && header->count >= 0 && header->count % 8 == 0 &&
+                 header->indexCount >= 0 && header->indexCount % 3 == 0 &&
+                 bytes == sizeof(ModelCacheHeader) + header->count*sizeof(float) + header->indexCount*sizeof(unsigned) &&
+                 header->sourceSize == (long long)source.st_size && header->sourceTime == (long long)source.st_mtime;
+    for (int i = 0; valid && i < header->indexCount; i++){
+        valid = indices[i] < (unsigned)header->count/8;
+    }
+    //last, once the sizes are known to be right: a cache corrupted in place keeps its structure
+    if (valid){
+        valid = header->checksum == checksumMesh(floats, header->count, indices, header->indexCount);
+    }
+    if (!valid){
+        munmap(mapped, bytes);
+        return false;
+    }
+    model.mapped = mapped;
+    model.mappedBytes = bytes;
+    model.floats = header->count > 0 ? floats : NULL;
+    model.count = header->count;
+    model.indices = header->indexCount > 0 ? indices : NULL;
+    model.indexCount = header->indexCount;
+    model.checksum = header->checksum;
+    model.fromCache = true;
+    return true;
+}
+
+//Written to a temporary file and renamed, so another launch never maps half a cache
+static void writeModelCache(const string& cachePath, const struct stat& source, const Model& model){
+    ModelCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "MDL2", 4);
+    header.checksum = model.checksum;
+    header.count = model.count;
+    header.indexCount = model.indexCount;
+    header.sourceSize = source.st_size;
+    header.sourceTime = source.st_mtime;
+    string tempPath = cachePath + ".tmp";
+    ofstream file(tempPath.c_str(), ios::binary);
+    if (!file) return;
+    file.write((const char*)&header, sizeof(header));
+    file.write((const char*)model.floats, model.count*sizeof(float));
+    file.write((const char*)model.indices, model.indexCount*sizeof(unsigned));
+    file.close();
+    if (!file || rename(tempPath.c_str(), cachePath.c_str()) != 0) remove(tempPath.c_str());
+}
+
+static bool hasExtension(const string& path, const char* extension){
+    size_t length = strlen(extension);
+    return path.size() >= length && strcasecmp(path.c_str() + path.size() - length, extension) == 0;
+}
+
+bool loadModel(const char* path, Model& model){
+    struct stat source;
+    if (stat(path, &source) != 0){
+        printf("Error: could not read model %s\n", path);
+        return false;
+    }
+    string cachePath = string(path) + ".bin";
+    if (mapModelCache(cachePath, source, model)) return true;
+    bool loaded;
+    if (hasExtension(path, ".obj")) loaded = loadModelObj(path, model);
+    else if (hasExtension(path, ".ply")) loaded = loadModelPly(path, model);
+    else loaded = loadModelText(path, model);
+    if (!loaded) return false;
+    //a read only models directory just means parsing every launch
+    writeModelCache(cachePath, source, model);
+    return true;
+}
+
+unsigned modelChecksum(const Model& model){
+    return checksumMesh(model.floats, model.count, model.indices, model.indexCount);
+}
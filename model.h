@@ -0,0 +1,54 @@
+#ifndef MODEL_H
+#define MODEL_H
+
+#include <cstddef>
+#include <vector>
+
+//Indexed triangle mesh, 8 floats per vertex (position xyz, texture uv, normal xyz) and 3 indices
+//per triangle. models/*.txt store a triangle soup (the float count, then 8 floats per corner),
+//.obj and binary .ply files are indexed already, all of them are welded into unique vertices.
+//The floats and indices either live in data/indexData or in the mapped binary cache.
+class Model{
+public:
+    Model();
+    ~Model();
+    int vertexCount() const { return count / 8; }
+    const float* vertex(int v) const { return floats + 8*v; }
+    int triangleCount() const { return indexCount / 3; }
+    //Corner c of triangle t
+    const float* corner(int t, int c) const { return vertex(indices[3*t + c]); }
+    //count floats and indexCount indices, ready to upload as they are
+    const float* floats;
+    int count;
+    const unsigned* indices;
+    int indexCount;
+    //modelChecksum of the mesh, computed once it is parsed and kept in the cache header
+    unsigned checksum;
+    std::vector<float> data;
+    std::vector<unsigned> indexData;
+    //Cache file mapping, NULL when the mesh is in data and indexData
+    void* mapped;
+    size_t mappedBytes;
+    //Whether loadModel mapped the cache rather than parsing the model
+    bool fromCache;
+private:
+    //the views may point into the vectors or a mapping, so models are not copied
+    Model(const Model&);
+    Model& operator=(const Model&);
+};
+
+//Loads path through its binary cache path.bin: the cache is mapped when its header matches the
+//source file's size and modification time, its size and indices match the header and its checksum
+//matches the mesh, otherwise
+//the file is parsed (by extension: .obj, .ply, anything else is the text soup) and the cache rewritten
+bool loadModel(const char* path, Model& model);
+//Parse the file only
+bool loadModelText(const char* path, Model& model);
+bool loadModelObj(const char* path, Model& model);
+//Binary little endian PLY with a vertex element (x y z, optional nx ny nz and u v or s t)
+//and a face element holding a vertex_indices list
+bool loadModelPly(const char* path, Model& model);
+//FNV-1a hash of the model's floats and indices, identifies the model data behind files derived from it
+unsigned modelChecksum(const Model& model);
+
+#endif
@@ -0,0 +1,296 @@
+#include "projectiveSolver.h"
+#include "collision.h"
+#include "selfCollision.h"
+
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+using namespace std;
+
+//Nested dissection of grid rows i0..i1-1 and columns j0..j1-1: the two halves of the region first,
+//then the line splitting them, so eliminating one half never fills in the other
+static void dissect(int n, int i0, int i1, int j0, int j1, vector<int>& order){
+    int height = i1 - i0, width = j1 - j0;
+    if (height <= 0 || width <= 0) return;
+    if (height*width <= 8){
+        for (int i = i0; i < i1; i++){
+            for (int j = j0; j < j1; j++) order.push_back(i*n + j);
+        }
+        return;
+    }
+    if (height >= width){
+        int mid = (i0 + i1)/2;
+        dissect(n, i0, mid, j0, j1, order);
+        dissect(n, mid+1, i1, j0, j1, order);
+        for (int j = j0; j < j1; j++) order.push_back(mid*n + j);
+    }
+    else{
+        int mid = (j0 + j1)/2;
+        dissect(n, i0, i1, j0, mid, order);
+        dissect(n, i0, i1, mid+1, j1, order);
+        for (int i = i0; i < i1; i++) order.push_back(i*n + mid);
+    }
+}
+
+//The ordering and the factor's sparsity pattern only depend on the grid, they are built once here
+ProjectiveSolver::ProjectiveSolver(int _n){
+    n = _n;
+    int M = n*n;
+    dissect(n, 0, n, 0, n, order);
+    position.resize(M);
+    for (int c = 0; c < M; c++) position[order[c]] = c;
+    neighbourStart.resize(M+1);
+    for (int c = 0; c < M; c++){
+        neighbourStart[c] = (int)neighbours.size();
+        int i = order[c] / n, j = order[c] % n;
+        int around[4][2] = {{i-1,j}, {i+1,j}, {i,j-1}, {i,j+1}};
+        for (int a = 0; a < 4; a++){
+            if (around[a][0] < 0 || around[a][0] >= n || around[a][1] < 0 || around[a][1] >= n) continue;
+            int other = position[around[a][0]*n + around[a][1]];
+            if (other < c) neighbours.push_back(other);
+        }
+    }
+    neighbourStart[M] = (int)neighbours.size();
+    //elimination tree, with path compression through ancestor
+    parent.assign(M, -1);
+    vector<int> ancestor(M, -1);
+    for (int c = 0; c < M; c++){
+        for (int p = neighbourStart[c]; p < neighbourStart[c+1]; p++){
+            for (int r = neighbours[p]; r != -1 && r < c; ){
+                int up = ancestor[r];
+                ancestor[r] = c;
+                if (up == -1) parent[r] = c;
+                r = up;
+            }
+        }
+    }
+    //column counts from the row patterns, then the column layout
+    stack.resize(M);
+    mark.assign(M, -1);
+    vector<long long> counts(M, 1);
+    for (int c = 0; c < M; c++){
+        for (int t = rowPattern(c); t < M; t++) counts[stack[t]]++;
+    }
+    colStart.resize(M+1);
+    colStart[0] = 0;
+    for (int c = 0; c < M; c++) colStart[c+1] = colStart[c] + counts[c];
+    rows.resize(colStart[M]);
+    values.resize(colStart[M]);
+    next.resize(M);
+    for (int axis = 0; axis < 3; axis++) work[axis].assign(M, 0.0);
+    factored = false;
+    factorKs = 0.0f;
+    factorDt = 0.0f;
+    factorPinned = false;
+    factorizations = 0;
+    prevPos.allocate(M);
+    inertial.allocate(M);
+    vertTarget.allocate(M);
+    horizTarget.allocate(M);
+    for (int axis = 0; axis < 3; axis++){
+        rhs[axis] = new double[M];
+    }
+}
+
+ProjectiveSolver::~ProjectiveSolver(){
+    prevPos.release();
+    inertial.release();
+    vertTarget.release();
+    horizTarget.release();
+    for (int axis = 0; axis < 3; axis++){
+        delete[] rhs[axis];
+    }
+}
+
+//Columns of L with an entry in row c (in topological order) in stack[top .. M-1], returns top.
+//They are the elimination tree paths from c's earlier neighbours up to c.
+int ProjectiveSolver::rowPattern(int c){
+    int top = n*n;
+    mark[c] = c;
+    for (int p = neighbourStart[c]; p < neighbourStart[c+1]; p++){
+        int length = 0;
+        for (int r = neighbours[p]; mark[r] != c; r = parent[r]){
+            stack[length++] = r;
+            mark[r] = c;
+        }
+        while (length > 0) stack[--top] = stack[--length];
+    }
+    return top;
+}
+
+//Fill in the factor of the system matrix, row by row (up-looking Cholesky).
+//Pinned particles keep their own row (identity), their springs move to the right hand side.
+void ProjectiveSolver::factorize(float ks, float dt, bool pinned){
+    int N = n;
+    int M = N*N;
+    double mass = 1.0/((double)dt*dt);
+    //the row scatter only clears the entries it visits, and solveFactored leaves its solution here
+    fill(work[0].begin(), work[0].end(), 0.0);
+    double* x = &work[0][0];
+    for (int c = 0; c < M; c++) next[c] = colStart[c];
+    for (int c = 0; c < M; c++){
+        int top = rowPattern(c);
+        int i = order[c] / N, j = order[c] % N;
+        bool fixed = pinned && i == 0;
+        for (int p = neighbourStart[c]; p < neighbourStart[c+1]; p++){
+            bool fixedNeighbour = pinned && order[neighbours[p]] / N == 0;
+            x[neighbours[p]] = fixed || fixedNeighbour ? 0.0 : -(double)ks;
+        }
+        int springs = (i > 0) + (i < N-1) + (j > 0) + (j < N-1);
+        double d = fixed ? 1.0 : mass + (double)ks*springs;
+        for (int t = top; t < M; t++){
+            int r = stack[t];
+            double l = x[r] / values[colStart[r]];
+            x[r] = 0.0;
+            for (long long p = colStart[r] + 1; p < next[r]; p++) x[rows[p]] -= values[p]*l;
+            d -= l*l;
+            long long p = next[r]++;
+            rows[p] = c;
+            values[p] = l;
+        }
+        long long p = next[c]++;
+        rows[p] = c;
+        values[p] = sqrt(d);
+    }
+    factored = true;
+    factorKs = ks;
+    factorDt = dt;
+    factorPinned = pinned;
+    factorizations++;
+}
+
+//Forward and back substitution with the cached factor for all three axes at once
+void ProjectiveSolver::solveFactored(double** rhs){
+    int M = n*n;
+    double* x = &work[0][0];
+    double* y = &work[1][0];
+    double* z = &work[2][0];
+    for (int c = 0; c < M; c++){
+        x[c] = rhs[0][order[c]];
+        y[c] = rhs[1][order[c]];
+        z[c] = rhs[2][order[c]];
+    }
+    for (int c = 0; c < M; c++){
+        double d = values[colStart[c]];
+        x[c] /= d;
+        y[c] /= d;
+        z[c] /= d;
+        for (long long p = colStart[c] + 1; p < colStart[c+1]; p++){
+            double l = values[p];
+            x[rows[p]] -= l*x[c];
+            y[rows[p]] -= l*y[c];
+            z[rows[p]] -= l*z[c];
+        }
+    }
+    for (int c = M-1; c >= 0; c--){
+        double sumX = x[c], sumY = y[c], sumZ = z[c];
+        for (long long p = colStart[c] + 1; p < colStart[c+1]; p++){
+            double l = values[p];
+            sumX -= l*x[rows[p]];
+            sumY -= l*y[rows[p]];
+            sumZ -= l*z[rows[p]];
+        }
+        double d = values[colStart[c]];
+        x[c] = sumX / d;
+        y[c] = sumY / d;
+        z[c] = sumZ / d;
+    }
+    for (int c = 0; c < M; c++){
+        rhs[0][order[c]] = x[c];
+        rhs[1][order[c]] = y[c];
+        rhs[2][order[c]] = z[c];
+    }
+}
+
+//Spring from b to a scaled to rest length, the local step of projective dynamics
+static glm::vec3 projectSpring(Cloth& cloth, int a, int b){
+    glm::vec3 d = cloth.pos.get(a) - cloth.pos.get(b);
+    float l = sqrt(dot(d,d));
+    if (l == 0.0f){
+        return glm::vec3(0,0,0);
+    }
+    return d*(cloth.l0/l);
+}
+
+void ProjectiveSolver::solve(Cloth& cloth, const SimParams& params, float dt){
+    int N = n;
+    bool pinned = !params.drop;
+    if (!factored || factorKs != params.ks || factorDt != dt || factorPinned != pinned){
+        factorize(params.ks, dt, pinned);
+    }
+    forEachRow(0, N, 1, [&](int i){
+        for (int k = cloth.index(i,0); k < cloth.index(i+1,0); k++) prevPos.set(k, cloth.pos.get(k));
+    });
+    //inertial prediction, gravity, wind, aero and the collisions through the shared pass
+    integratePositions(cloth, params, dt);
+    forEachRow(0, N, 1, [&](int i){
+        for (int k = cloth.index(i,0); k < cloth.index(i+1,0); k++) inertial.set(k, cloth.pos.get(k));
+    });
+
+    double mass = 1.0/((double)dt*dt);
+    double ks = params.ks;
+    for (int iteration = 0; iteration < params.solverIterations; iteration++){
+        //local, each row projects the springs that start in it
+        forEachRow(0, N, 1, [&](int i){
+            for (int j = 0; j < N; j++){
+                int k = cloth.index(i,j);
+                if (i < N-1) vertTarget.set(k, projectSpring(cloth, k, k+N));
+                if (j < N-1) horizTarget.set(k, projectSpring(cloth, k, k+1));
+            }
+        });
+        //global right hand side
+        forEachRow(0, N, 1, [&](int i){
+            for (int j = 0; j < N; j++){
+                int k = cloth.index(i,j);
+                glm::vec3 p = cloth.pos.get(k);
+                if (pinned && i == 0){
+                    for (int axis = 0; axis < 3; axis++) rhs[axis][k] = p[axis];
+                    continue;
+                }
+                glm::vec3 target(0,0,0);
+                if (i < N-1) target += vertTarget.get(k);
+                if (i > 0) target -= vertTarget.get(k-N);
+                if (j < N-1) target += horizTarget.get(k);
+                if (j > 0) target -= horizTarget.get(k-1);
+                //springs to pinned particles were moved out of the matrix
+                if (pinned && i == 1) target += cloth.pos.get(k-N);
+                glm::vec3 s = inertial.get(k);
+                for (int axis = 0; axis < 3; axis++) rhs[axis][k] = mass*s[axis] + ks*target[axis];
+            }
+        });
+        //global solve
+        solveFactored(rhs);
+        forEachRow(0, N, 1, [&](int i){
+            for (int k = cloth.index(i,0); k < cloth.index(i+1,0); k++){
+                cloth.pos.set(k, glm::vec3(rhs[0][k], rhs[1][k], rhs[2][k]));
+            }
+        });
+    }
+
+    //velocity from the solved positions, particles updateRow left on the floor stay where they were
+    forEachRow(0, N, 1, [&](int i){
+        for (int k = cloth.index(i,0); k < cloth.index(i+1,0); k++){
+            if (prevPos.y[k] - (-2.0) < .02f){
+                cloth.pos.set(k, prevPos.get(k));
+                continue;
+            }
+            if (pinned && i == 0){
+                continue;
+            }
+            cloth.vel.set(k, (cloth.pos.get(k) - prevPos.get(k))*(1.0f/dt));
+            collideSphere(cloth, params, k);
+            if (cloth.pos.y[k] < -2.0f){
+                cloth.pos.y[k] = -2.0f;
+            }
+        }
+    });
+    collideObstacles(cloth, params, dt);
+    collideSelf(cloth, params, NULL);
+}
+
+void projectiveUpdate(Cloth& cloth, const SimParams& params, float dt){
+    if (cloth.projectiveSolver == NULL){
+        cloth.projectiveSolver = new ProjectiveSolver(cloth.n);
+    }
+    cloth.projectiveSolver->solve(cloth, params, dt);
+}
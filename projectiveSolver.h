@@ -0,0 +1,55 @@
+#ifndef PROJECTIVESOLVER_H
+#define PROJECTIVESOLVER_H
+
+#include "clothSim.h"
+
+#include <vector>
+
+//Projective dynamics. Every step alternates a local pass that projects each structural spring
+//to its rest length with a global solve of
+//  (I/dt^2 + ks*L) q = s/dt^2 + ks*(projected spring targets)
+//where L is the spring graph Laplacian. The matrix only depends on ks, dt and which particles
+//are pinned, so its sparse Cholesky factor is cached and rebuilt only when one of those changes.
+//Particles are eliminated in nested dissection order, which keeps the factor at O(n^2 log n)
+//entries for an n x n grid: factoring costs O(n^3) and each global solve O(n^2 log n).
+class ProjectiveSolver{
+public:
+    ProjectiveSolver(int n);
+    ~ProjectiveSolver();
+    void solve(Cloth& cloth, const SimParams& params, float dt);
+    void factorize(float ks, float dt, bool pinned);
+    //Overwrite rhs (one array per axis, grid order) with the solution
+    void solveFactored(double** rhs);
+    int n;
+    //Elimination order, particle order[c] is eliminated c-th, and its inverse
+    std::vector<int> order, position;
+    //Factor L by columns in elimination order, column c holds rows[colStart[c] .. colStart[c+1]-1]
+    //with the diagonal first, and the matching values
+    std::vector<long long> colStart;
+    std::vector<int> rows;
+    std::vector<double> values;
+    //What the factor was built for
+    bool factored;
+    float factorKs;
+    float factorDt;
+    bool factorPinned;
+    int factorizations;
+    Vec3Array prevPos;
+    Vec3Array inertial;
+    //Projected spring vectors, vertical spring k joins k and k+n, horizontal k joins k and k+1
+    Vec3Array vertTarget, horizTarget;
+    //Right hand side per axis, the global solve overwrites it with the new positions
+    double* rhs[3];
+private:
+    int rowPattern(int c);
+    //Grid neighbours eliminated before c, the pattern of the matrix above the diagonal
+    std::vector<int> neighbourStart, neighbours;
+    //Elimination tree
+    std::vector<int> parent;
+    //Scratch for rowPattern, the factorization and the solve
+    std::vector<int> stack, mark;
+    std::vector<long long> next;
+    std::vector<double> work[3];
+};
+
+#endif
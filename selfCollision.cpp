@@ -0,0 +1,171 @@
+#include "selfCollision.h"
+
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+using namespace std;
+
+SelfCollision::SelfCollision(int _n){
+    n = _n;
+    cellSize = 0.0f;
+    int triangles = 2*(n-1)*(n-1);
+    //power of two buckets, about two per triangle
+    int buckets = 1;
+    while (buckets < 2*triangles) buckets *= 2;
+    start.resize(buckets + 1);
+    cells.resize(6*triangles);
+    centroids.allocate(triangles);
+    radius = allocateFloats(triangles);
+    dPos.allocate(n*n);
+    dVel.allocate(n*n);
+    contacts = 0;
+}
+
+SelfCollision::~SelfCollision(){
+    dPos.release();
+    dVel.release();
+    centroids.release();
+    free(radius);
+}
+
+static inline int bucketOf(int x, int y, int z, int buckets){
+    return (int)(((unsigned)x*73856093u ^ (unsigned)y*19349663u ^ (unsigned)z*83492791u) & (unsigned)(buckets - 1));
+}
+
+//Corners of triangle t, half t%2 of the quad whose top left particle is (t/2)/(n-1), (t/2)%(n-1)
+static inline void triangleCorners(int n, int t, int& a, int& b, int& c){
+    int q = t >> 1;
+    int k = (q/(n-1))*n + q%(n-1);
+    if ((t & 1) == 0){ a = k; b = k+n; c = k+1; }
+    else{ a = k+1; b = k+n; c = k+n+1; }
+}
+
+void SelfCollision::collide(Cloth& cloth, const SimParams& params, const bool* frozen){
+    int N = n;
+    int triangles = 2*(N-1)*(N-1);
+    int buckets = (int)start.size() - 1;
+    float thickness = params.selfThickness;
+    //two rest lengths across, a grown triangle then covers about 2x2 cells and a bucket holds about
+    //twenty, smaller cells shorten the buckets but make the serial counting sort longer
+    cellSize = 2.0f*max(cloth.l0, 2.0f*thickness);
+    float inv = 1.0f/cellSize;
+    Vec3Array& pos = cloth.pos;
+    Vec3Array& vel = cloth.vel;
+    
+    //bounding sphere and the cell range of the bounds grown by the thickness, a range wider than
+    //a few cells (a torn or exploded triangle) is clamped rather than flooding the table
+    forEachRow(0, N-1, 1, [&](int i){
+        for (int t = 2*i*(N-1); t < 2*(i+1)*(N-1); t++){
+            int a, b, c;
+            triangleCorners(N, t, a, b, c);
+            glm::vec3 centroid = (pos.get(a) + pos.get(b) + pos.get(c))/3.0f;
+            glm::vec3 da = pos.get(a) - centroid, db = pos.get(b) - centroid, dc = pos.get(c) - centroid;
+            centroids.set(t, centroid);
+            radius[t] = sqrt(max(dot(da,da), max(dot(db,db), dot(dc,dc))));
+            int* range = &cells[6*t];
+            for (int axis = 0; axis < 3; axis++){
+                const float* p = axis == 0 ? pos.x : axis == 1 ? pos.y : pos.z;
+                float lo = (min(min(p[a],p[b]),p[c]) - thickness)*inv;
+                float hi = (max(max(p[a],p[b]),p[c]) + thickness)*inv;
+                if (!(fabs(lo) < 1e6f && fabs(hi) < 1e6f)){
+                    lo = hi = 0.0f;
+                }
+                range[axis] = (int)floor(lo);
+                range[axis+3] = min((int)floor(hi), range[axis] + 3);
+            }
+        }
+    });
+    //counting sort into the buckets, triangles stay in index order within a bucket
+    fill(start.begin(), start.end(), 0);
+    for (int t = 0; t < triangles; t++){
+        const int* range = &cells[6*t];
+        for (int z = range[2]; z <= range[5]; z++)
+            for (int y = range[1]; y <= range[4]; y++)
+                for (int x = range[0]; x <= range[3]; x++) start[bucketOf(x,y,z,buckets) + 1]++;
+    }
+    for (int b = 0; b < buckets; b++) start[b+1] += start[b];
+    entries.resize(start[buckets]);
+    vector<int> next(start.begin(), start.end() - 1);
+    for (int t = 0; t < triangles; t++){
+        const int* range = &cells[6*t];
+        for (int z = range[2]; z <= range[5]; z++)
+            for (int y = range[1]; y <= range[4]; y++)
+                for (int x = range[0]; x <= range[3]; x++) entries[next[bucketOf(x,y,z,buckets)]++] = t;
+    }
+    
+    //every particle against the triangles in its bucket, reading only the current state
+    vector<int> rowContacts(N, 0);
+    forEachRow(0, N, 1, [&](int i){
+        for (int j = 0; j < N; j++){
+            int k = cloth.index(i,j);
+            dPos.set(k, glm::vec3(0,0,0));
+            dVel.set(k, glm::vec3(0,0,0));
+            if ((frozen != NULL && frozen[i]) || (i == 0 && !params.drop) || pos.y[k] - (-2.0) < .02f) continue;
+            glm::vec3 p = pos.get(k);
+            if (!(fabs(p[0]) + fabs(p[1]) + fabs(p[2]) < 1e6f*cellSize)) continue;
+            int b = bucketOf((int)floor(p[0]*inv), (int)floor(p[1]*inv), (int)floor(p[2]*inv), buckets);
+            float deepest = 0.0f;
+            for (int e = start[b]; e < start[b+1]; e++){
+                int t = entries[e];
+                //triangles touching the particle or its direct neighbours are bent, not colliding
+                int q = t >> 1, qi = q/(N-1), qj = q%(N-1);
+                if (qi >= i-2 && qi <= i+1 && qj >= j-2 && qj <= j+1) continue;
+                //bounding sphere first, most candidates are rejected here
+                glm::vec3 fromCentroid = p - centroids.get(t);
+                float reach = radius[t] + thickness;
+                if (dot(fromCentroid,fromCentroid) >= reach*reach) continue;
+                int ka, kb, kc;
+                triangleCorners(N, t, ka, kb, kc);
+                glm::vec3 a = pos.get(ka);
+                glm::vec3 e1 = pos.get(kb) - a, e2 = pos.get(kc) - a;
+                glm::vec3 normal = cross(e1, e2);
+                float area2 = dot(normal,normal);
+                if (!(area2 > 0.0f)) continue;
+                normal = normal*(1.0f/sqrt(area2));
+                float d = dot(p - a, normal);
+                if (!(fabs(d) < thickness) || thickness - fabs(d) <= deepest) continue;
+                //barycentric coordinates of the projection, it has to land inside the triangle
+                glm::vec3 r = p - d*normal - a;
+                float d11 = dot(e1,e1), d12 = dot(e1,e2), d22 = dot(e2,e2);
+                float r1 = dot(r,e1), r2 = dot(r,e2);
+                float denom = d11*d22 - d12*d12;
+                if (!(denom > 0.0f)) continue;
+                float wb = (d22*r1 - d12*r2)/denom;
+                float wc = (d11*r2 - d12*r1)/denom;
+                float wa = 1.0f - wb - wc;
+                if (wa < 0.0f || wb < 0.0f || wc < 0.0f) continue;
+                //push to the side the particle is on, half the overlap since the triangle's
+                //particles are pushed the other way by their own queries
+                float side = d >= 0.0f ? 1.0f : -1.0f;
+                deepest = thickness - fabs(d);
+                glm::vec3 out = side*normal;
+                dPos.set(k, (.5f*deepest)*out);
+                glm::vec3 surfaceVel = wa*vel.get(ka) + wb*vel.get(kb) + wc*vel.get(kc);
+                float approach = dot(vel.get(k) - surfaceVel, out);
+                dVel.set(k, approach < 0.0f ? (-.5f*approach)*out : glm::vec3(0,0,0));
+            }
+            if (deepest > 0.0f) rowContacts[i]++;
+        }
+    });
+    forEachRow(0, N, 1, [&](int i){
+        for (int k = cloth.index(i,0); k < cloth.index(i+1,0); k++){
+            pos.add(k, dPos.get(k));
+            vel.add(k, dVel.get(k));
+            if (pos.y[k] < -2.0f){
+                pos.y[k] = -2.0f;
+            }
+        }
+    });
+    contacts = 0;
+    for (int i = 0; i < N; i++) contacts += rowContacts[i];
+}
+
+void collideSelf(Cloth& cloth, const SimParams& params, const bool* frozen){
+    if (!(params.selfThickness > 0.0f)){
+        return;
+    }
+    if (cloth.selfCollision == NULL){
+        cloth.selfCollision = new SelfCollision(cloth.n);
+    }
+    cloth.selfCollision->collide(cloth, params, frozen);
+}
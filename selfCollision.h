@@ -0,0 +1,37 @@
+#ifndef SELFCOLLISION_H
+#define SELFCOLLISION_H
+
+#include "clothSim.h"
+
+#include <vector>
+
+//Proximity repulsion between particles and the cloth's own triangles. Every step the triangles,
+//grown by the thickness, are binned into a uniform spatial hash with a counting sort, then each
+//particle looks up the one bucket it falls in (in parallel) and is pushed out of the triangle it
+//is deepest inside the thickness of. Building and querying are both linear in the particle count.
+class SelfCollision{
+public:
+    SelfCollision(int n);
+    ~SelfCollision();
+    //Rows flagged in frozen (may be NULL) are not moved
+    void collide(Cloth& cloth, const SimParams& params, const bool* frozen);
+    int n;
+    float cellSize;
+    //Bucket b holds triangles entries[start[b] .. start[b+1]-1], triangle t is half t%2 of quad t/2
+    std::vector<int> start;
+    std::vector<int> entries;
+    //Per triangle centroid, distance from it to the furthest corner and cell range of the grown
+    //bounds (lo xyz, hi xyz)
+    Vec3Array centroids;
+    float* radius;
+    std::vector<int> cells;
+    //Position and velocity changes, gathered from the current state before any is applied
+    Vec3Array dPos, dVel;
+    //Particles that were pushed in the last step, for reporting
+    int contacts;
+};
+
+//Create the cloth's SelfCollision state when needed and run it, a no-op while params.selfThickness is 0
+void collideSelf(Cloth& cloth, const SimParams& params, const bool* frozen);
+
+#endif
@@ -0,0 +1,401 @@
+#include "clothSim.h"
+
+#include <cmath>
+#include <string>
+#include <algorithm>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+using namespace std;
+
+SpringKernels springKernels;
+
+//Damped structural spring between particles a and b, applied to both endpoints
+static inline void applySpring(Cloth& cloth, int a, int b, float ks, float kd){
+    glm::vec3 e = cloth.pos.get(b) - cloth.pos.get(a);
+    float l = sqrt(dot(e,e));
+    e = e * (1.0f/l);
+    float v1 = dot(e,cloth.vel.get(a));
+    float v2 = dot(e,cloth.vel.get(b));
+    float f = (-1.0f*ks*(cloth.l0-l))-(kd*(v1-v2));
+    cloth.vel.add(a, f*e);
+    cloth.vel.sub(b, f*e);
+}
+
+static void verticalSpringsScalar(Cloth& cloth, int i, float ks, float kd){
+    int N = cloth.n;
+    for (int j = 0; j < N; j++){
+        int k = cloth.index(i,j);
+        applySpring(cloth, k, k+N, ks, kd);
+    }
+}
+
+//Even springs (j, j+1) first, then the odd ones, the same order the vector kernels use
+static void horizontalSpringsScalar(Cloth& cloth, int i, float ks, float kd){
+    int N = cloth.n;
+    for (int parity = 0; parity < 2; parity++){
+        for (int j = parity; j < N-1; j += 2){
+            int k = cloth.index(i,j);
+            applySpring(cloth, k, k+1, ks, kd);
+        }
+    }
+}
+
+//Normal and aero impulse of quad (i,j), see SpringKernels::aero
+static inline void aeroQuad(Cloth& cloth, int i, int j, float scale, float drag){
+    int N = cloth.n;
+    int k = cloth.index(i,j);
+    const Vec3Array& pos = cloth.pos;
+    const Vec3Array& vel = cloth.vel;
+    glm::vec3 n = cross(pos.get(k+1) - pos.get(k+N), pos.get(k+N+1) - pos.get(k));
+    glm::vec3 v = (vel.get(k) + vel.get(k+1) + vel.get(k+N) + vel.get(k+N+1))*.25f;
+    float vv = dot(v,v), nn = dot(n,n);
+    //speed*dot(v,n)/|n|, nothing for a collapsed quad
+    float a = nn > 0.0f ? scale*sqrt(vv/nn)*dot(v,n) : 0.0f;
+    a = a/(1.0f + drag*sqrt(vv*nn));
+    int f = cloth.face(i,j);
+    cloth.faceNormal.set(f, n);
+    cloth.faceAero.set(f, a*n);
+}
+
+static void aeroScalar(Cloth& cloth, int i, float scale, float drag){
+    for (int j = 0; j < cloth.n-1; j++) aeroQuad(cloth, i, j, scale, drag);
+}
+
+//Normal of particle (i,j) from central differences. (right-left) x (below-above) is the sum of the
+//normals of the four triangles fanned around the particle, so it is their area weighted mean.
+//Missing neighbours on the border are replaced by the particle itself.
+static inline void vertexNormal(Cloth& cloth, int i, int j){
+    int N = cloth.n;
+    const Vec3Array& pos = cloth.pos;
+    int k = cloth.index(i,j);
+    glm::vec3 u = pos.get(j < N-1 ? k+1 : k) - pos.get(j > 0 ? k-1 : k);
+    glm::vec3 v = pos.get(i < N-1 ? k+N : k) - pos.get(i > 0 ? k-N : k);
+    cloth.norm.set(k, normalize(cross(u,v)));
+}
+
+static void normalsScalar(Cloth& cloth, int i){
+    for (int j = 0; j < cloth.n; j++) vertexNormal(cloth, i, j);
+}
+
+#if defined(__x86_64__)
+//The vertical springs of one row never share a particle, so 8 (AVX2) or 4 (SSE)
+//of them are evaluated at once. Horizontal springs are chained along the row, so
+//they run as two passes: the even springs (j, j+1), then the odd ones.
+
+__attribute__((target("avx2,fma")))
+static void verticalSpringsAvx2(Cloth& cloth, int i, float ks, float kd){
+    int N = cloth.n;
+    const float *ax = cloth.pos.x+i*N, *ay = cloth.pos.y+i*N, *az = cloth.pos.z+i*N;
+    float *avx = cloth.vel.x+i*N, *avy = cloth.vel.y+i*N, *avz = cloth.vel.z+i*N;
+    __m256 vks = _mm256_set1_ps(ks), vkd = _mm256_set1_ps(kd);
+    __m256 vl0 = _mm256_set1_ps(cloth.l0), one = _mm256_set1_ps(1.0f);
+    int j = 0;
+    for (; j + 8 <= N; j += 8){
+        __m256 ex = _mm256_sub_ps(_mm256_loadu_ps(ax+N+j), _mm256_loadu_ps(ax+j));
+        __m256 ey = _mm256_sub_ps(_mm256_loadu_ps(ay+N+j), _mm256_loadu_ps(ay+j));
+        __m256 ez = _mm256_sub_ps(_mm256_loadu_ps(az+N+j), _mm256_loadu_ps(az+j));
+        __m256 l = _mm256_sqrt_ps(_mm256_fmadd_ps(ex,ex,_mm256_fmadd_ps(ey,ey,_mm256_mul_ps(ez,ez))));
+        __m256 inv = _mm256_div_ps(one, l);
+        ex = _mm256_mul_ps(ex,inv); ey = _mm256_mul_ps(ey,inv); ez = _mm256_mul_ps(ez,inv);
+        __m256 v1x = _mm256_loadu_ps(avx+j), v1y = _mm256_loadu_ps(avy+j), v1z = _mm256_loadu_ps(avz+j);
+        __m256 v2x = _mm256_loadu_ps(avx+N+j), v2y = _mm256_loadu_ps(avy+N+j), v2z = _mm256_loadu_ps(avz+N+j);
+        __m256 dv = _mm256_fmadd_ps(ex,_mm256_sub_ps(v1x,v2x),_mm256_fmadd_ps(ey,_mm256_sub_ps(v1y,v2y),_mm256_mul_ps(ez,_mm256_sub_ps(v1z,v2z))));
+        __m256 f = _mm256_fmsub_ps(vks,_mm256_sub_ps(l,vl0),_mm256_mul_ps(vkd,dv));
+        __m256 fx = _mm256_mul_ps(f,ex), fy = _mm256_mul_ps(f,ey), fz = _mm256_mul_ps(f,ez);
+        _mm256_storeu_ps(avx+j, _mm256_add_ps(v1x,fx));
+        _mm256_storeu_ps(avy+j, _mm256_add_ps(v1y,fy));
+        _mm256_storeu_ps(avz+j, _mm256_add_ps(v1z,fz));
+        _mm256_storeu_ps(avx+N+j, _mm256_sub_ps(v2x,fx));
+        _mm256_storeu_ps(avy+N+j, _mm256_sub_ps(v2y,fy));
+        _mm256_storeu_ps(avz+N+j, _mm256_sub_ps(v2z,fz));
+    }
+    for (; j < N; j++){
+        int k = cloth.index(i,j);
+        applySpring(cloth, k, k+N, ks, kd);
+    }
+}
+
+//Load 16 floats and split them into the even and odd elements
+__attribute__((target("avx2,fma")))
+static inline void splitEvenOddAvx2(const float* p, __m256& even, __m256& odd){
+    __m256 a = _mm256_loadu_ps(p), b = _mm256_loadu_ps(p+8);
+    even = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(_mm256_shuffle_ps(a,b,_MM_SHUFFLE(2,0,2,0))), 0xD8));
+    odd = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(_mm256_shuffle_ps(a,b,_MM_SHUFFLE(3,1,3,1))), 0xD8));
+}
+
+//Inverse of splitEvenOddAvx2
+__attribute__((target("avx2,fma")))
+static inline void mergeEvenOddAvx2(float* p, __m256 even, __m256 odd){
+    __m256 lo = _mm256_unpacklo_ps(even, odd), hi = _mm256_unpackhi_ps(even, odd);
+    _mm256_storeu_ps(p, _mm256_permute2f128_ps(lo, hi, 0x20));
+    _mm256_storeu_ps(p+8, _mm256_permute2f128_ps(lo, hi, 0x31));
+}
+
+//Springs (first+2t, first+2t+1) for t < pairs. The pairs share no particle, so
+//particles are split into even and odd lanes and 8 springs run at once
+__attribute__((target("avx2,fma")))
+static void pairedSpringsAvx2(Cloth& cloth, int first, int pairs, float ks, float kd){
+    float *px = cloth.pos.x+first, *py = cloth.pos.y+first, *pz = cloth.pos.z+first;
+    float *vx = cloth.vel.x+first, *vy = cloth.vel.y+first, *vz = cloth.vel.z+first;
+    __m256 vks = _mm256_set1_ps(ks), vkd = _mm256_set1_ps(kd);
+    __m256 vl0 = _mm256_set1_ps(cloth.l0), one = _mm256_set1_ps(1.0f);
+    int t = 0;
+    for (; t + 8 <= pairs; t += 8){
+        int j = 2*t;
+        __m256 ax, ay, az, bx, by, bz, avx, avy, avz, bvx, bvy, bvz;
+        splitEvenOddAvx2(px+j, ax, bx); splitEvenOddAvx2(py+j, ay, by); splitEvenOddAvx2(pz+j, az, bz);
+        splitEvenOddAvx2(vx+j, avx, bvx); splitEvenOddAvx2(vy+j, avy, bvy); splitEvenOddAvx2(vz+j, avz, bvz);
+        __m256 ex = _mm256_sub_ps(bx,ax), ey = _mm256_sub_ps(by,ay), ez = _mm256_sub_ps(bz,az);
+        __m256 l = _mm256_sqrt_ps(_mm256_fmadd_ps(ex,ex,_mm256_fmadd_ps(ey,ey,_mm256_mul_ps(ez,ez))));
+        __m256 inv = _mm256_div_ps(one, l);
+        ex = _mm256_mul_ps(ex,inv); ey = _mm256_mul_ps(ey,inv); ez = _mm256_mul_ps(ez,inv);
+        __m256 dv = _mm256_fmadd_ps(ex,_mm256_sub_ps(avx,bvx),_mm256_fmadd_ps(ey,_mm256_sub_ps(avy,bvy),_mm256_mul_ps(ez,_mm256_sub_ps(avz,bvz))));
+        __m256 f = _mm256_fmsub_ps(vks,_mm256_sub_ps(l,vl0),_mm256_mul_ps(vkd,dv));
+        __m256 fx = _mm256_mul_ps(f,ex), fy = _mm256_mul_ps(f,ey), fz = _mm256_mul_ps(f,ez);
+        mergeEvenOddAvx2(vx+j, _mm256_add_ps(avx,fx), _mm256_sub_ps(bvx,fx));
+        mergeEvenOddAvx2(vy+j, _mm256_add_ps(avy,fy), _mm256_sub_ps(bvy,fy));
+        mergeEvenOddAvx2(vz+j, _mm256_add_ps(avz,fz), _mm256_sub_ps(bvz,fz));
+    }
+    for (; t < pairs; t++){
+        applySpring(cloth, first+2*t, first+2*t+1, ks, kd);
+    }
+}
+
+__attribute__((target("avx2,fma")))
+static void horizontalSpringsAvx2(Cloth& cloth, int i, float ks, float kd){
+    int N = cloth.n;
+    pairedSpringsAvx2(cloth, cloth.index(i,0), N/2, ks, kd);
+    pairedSpringsAvx2(cloth, cloth.index(i,1), (N-1)/2, ks, kd);
+}
+
+//Quads are independent, 8 of them at once
+__attribute__((target("avx2,fma")))
+static void aeroAvx2(Cloth& cloth, int i, float scale, float drag){
+    int N = cloth.n;
+    const float *px = cloth.pos.x+i*N, *py = cloth.pos.y+i*N, *pz = cloth.pos.z+i*N;
+    const float *vx = cloth.vel.x+i*N, *vy = cloth.vel.y+i*N, *vz = cloth.vel.z+i*N;
+    int f = cloth.face(i,0);
+    float *nx = cloth.faceNormal.x+f, *ny = cloth.faceNormal.y+f, *nz = cloth.faceNormal.z+f;
+    float *ax = cloth.faceAero.x+f, *ay = cloth.faceAero.y+f, *az = cloth.faceAero.z+f;
+    __m256 vscale = _mm256_set1_ps(scale), vdrag = _mm256_set1_ps(drag);
+    __m256 quarter = _mm256_set1_ps(.25f), one = _mm256_set1_ps(1.0f), zero = _mm256_setzero_ps();
+    int j = 0;
+    for (; j + 8 <= N-1; j += 8){
+        //diagonals (i,j+1)-(i+1,j) and (i+1,j+1)-(i,j)
+        __m256 d1x = _mm256_sub_ps(_mm256_loadu_ps(px+j+1), _mm256_loadu_ps(px+N+j));
+        __m256 d1y = _mm256_sub_ps(_mm256_loadu_ps(py+j+1), _mm256_loadu_ps(py+N+j));
+        __m256 d1z = _mm256_sub_ps(_mm256_loadu_ps(pz+j+1), _mm256_loadu_ps(pz+N+j));
+        __m256 d2x = _mm256_sub_ps(_mm256_loadu_ps(px+N+j+1), _mm256_loadu_ps(px+j));
+        __m256 d2y = _mm256_sub_ps(_mm256_loadu_ps(py+N+j+1), _mm256_loadu_ps(py+j));
+        __m256 d2z = _mm256_sub_ps(_mm256_loadu_ps(pz+N+j+1), _mm256_loadu_ps(pz+j));
+        __m256 cx = _mm256_fmsub_ps(d1y,d2z,_mm256_mul_ps(d1z,d2y));
+        __m256 cy = _mm256_fmsub_ps(d1z,d2x,_mm256_mul_ps(d1x,d2z));
+        __m256 cz = _mm256_fmsub_ps(d1x,d2y,_mm256_mul_ps(d1y,d2x));
+        __m256 ux = _mm256_mul_ps(quarter, _mm256_add_ps(_mm256_add_ps(_mm256_loadu_ps(vx+j), _mm256_loadu_ps(vx+j+1)), _mm256_add_ps(_mm256_loadu_ps(vx+N+j), _mm256_loadu_ps(vx+N+j+1))));
+        __m256 uy = _mm256_mul_ps(quarter, _mm256_add_ps(_mm256_add_ps(_mm256_loadu_ps(vy+j), _mm256_loadu_ps(vy+j+1)), _mm256_add_ps(_mm256_loadu_ps(vy+N+j), _mm256_loadu_ps(vy+N+j+1))));
+        __m256 uz = _mm256_mul_ps(quarter, _mm256_add_ps(_mm256_add_ps(_mm256_loadu_ps(vz+j), _mm256_loadu_ps(vz+j+1)), _mm256_add_ps(_mm256_loadu_ps(vz+N+j), _mm256_loadu_ps(vz+N+j+1))));
+        __m256 vv = _mm256_fmadd_ps(ux,ux,_mm256_fmadd_ps(uy,uy,_mm256_mul_ps(uz,uz)));
+        __m256 nn = _mm256_fmadd_ps(cx,cx,_mm256_fmadd_ps(cy,cy,_mm256_mul_ps(cz,cz)));
+        __m256 vn = _mm256_fmadd_ps(ux,cx,_mm256_fmadd_ps(uy,cy,_mm256_mul_ps(uz,cz)));
+        __m256 live = _mm256_cmp_ps(nn, zero, _CMP_GT_OQ);
+        __m256 a = _mm256_mul_ps(_mm256_mul_ps(vscale, _mm256_sqrt_ps(_mm256_div_ps(vv,nn))), vn);
+        a = _mm256_and_ps(live, _mm256_div_ps(a, _mm256_fmadd_ps(vdrag, _mm256_sqrt_ps(_mm256_mul_ps(vv,nn)), one)));
+        _mm256_storeu_ps(nx+j, cx); _mm256_storeu_ps(ny+j, cy); _mm256_storeu_ps(nz+j, cz);
+        _mm256_storeu_ps(ax+j, _mm256_mul_ps(a,cx)); _mm256_storeu_ps(ay+j, _mm256_mul_ps(a,cy)); _mm256_storeu_ps(az+j, _mm256_mul_ps(a,cz));
+    }
+    for (; j < N-1; j++) aeroQuad(cloth, i, j, scale, drag);
+}
+
+//Interior columns 8 at once, rows above and below are clamped for the whole row
+__attribute__((target("avx2,fma")))
+static void normalsAvx2(Cloth& cloth, int i){
+    int N = cloth.n;
+    int above = i > 0 ? (i-1)*N : i*N, below = i < N-1 ? (i+1)*N : i*N;
+    const float *px = cloth.pos.x+i*N, *py = cloth.pos.y+i*N, *pz = cloth.pos.z+i*N;
+    float *nx = cloth.norm.x+i*N, *ny = cloth.norm.y+i*N, *nz = cloth.norm.z+i*N;
+    __m256 one = _mm256_set1_ps(1.0f);
+    vertexNormal(cloth, i, 0);
+    int j = 1;
+    for (; j + 8 <= N-1; j += 8){
+        __m256 ux = _mm256_sub_ps(_mm256_loadu_ps(px+j+1), _mm256_loadu_ps(px+j-1));
+        __m256 uy = _mm256_sub_ps(_mm256_loadu_ps(py+j+1), _mm256_loadu_ps(py+j-1));
+        __m256 uz = _mm256_sub_ps(_mm256_loadu_ps(pz+j+1), _mm256_loadu_ps(pz+j-1));
+        __m256 vx = _mm256_sub_ps(_mm256_loadu_ps(cloth.pos.x+below+j), _mm256_loadu_ps(cloth.pos.x+above+j));
+        __m256 vy = _mm256_sub_ps(_mm256_loadu_ps(cloth.pos.y+below+j), _mm256_loadu_ps(cloth.pos.y+above+j));
+        __m256 vz = _mm256_sub_ps(_mm256_loadu_ps(cloth.pos.z+below+j), _mm256_loadu_ps(cloth.pos.z+above+j));
+        __m256 cx = _mm256_fmsub_ps(uy,vz,_mm256_mul_ps(uz,vy));
+        __m256 cy = _mm256_fmsub_ps(uz,vx,_mm256_mul_ps(ux,vz));
+        __m256 cz = _mm256_fmsub_ps(ux,vy,_mm256_mul_ps(uy,vx));
+        __m256 inv = _mm256_div_ps(one, _mm256_sqrt_ps(_mm256_fmadd_ps(cx,cx,_mm256_fmadd_ps(cy,cy,_mm256_mul_ps(cz,cz)))));
+        _mm256_storeu_ps(nx+j, _mm256_mul_ps(cx,inv));
+        _mm256_storeu_ps(ny+j, _mm256_mul_ps(cy,inv));
+        _mm256_storeu_ps(nz+j, _mm256_mul_ps(cz,inv));
+    }
+    for (; j < N; j++) vertexNormal(cloth, i, j);
+}
+
+static void verticalSpringsSse(Cloth& cloth, int i, float ks, float kd){
+    int N = cloth.n;
+    const float *ax = cloth.pos.x+i*N, *ay = cloth.pos.y+i*N, *az = cloth.pos.z+i*N;
+    float *avx = cloth.vel.x+i*N, *avy = cloth.vel.y+i*N, *avz = cloth.vel.z+i*N;
+    __m128 vks = _mm_set1_ps(ks), vkd = _mm_set1_ps(kd);
+    __m128 vl0 = _mm_set1_ps(cloth.l0), one = _mm_set1_ps(1.0f);
+    int j = 0;
+    for (; j + 4 <= N; j += 4){
+        __m128 ex = _mm_sub_ps(_mm_loadu_ps(ax+N+j), _mm_loadu_ps(ax+j));
+        __m128 ey = _mm_sub_ps(_mm_loadu_ps(ay+N+j), _mm_loadu_ps(ay+j));
+        __m128 ez = _mm_sub_ps(_mm_loadu_ps(az+N+j), _mm_loadu_ps(az+j));
+        __m128 l = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(ex,ex),_mm_add_ps(_mm_mul_ps(ey,ey),_mm_mul_ps(ez,ez))));
+        __m128 inv = _mm_div_ps(one, l);
+        ex = _mm_mul_ps(ex,inv); ey = _mm_mul_ps(ey,inv); ez = _mm_mul_ps(ez,inv);
+        __m128 v1x = _mm_loadu_ps(avx+j), v1y = _mm_loadu_ps(avy+j), v1z = _mm_loadu_ps(avz+j);
+        __m128 v2x = _mm_loadu_ps(avx+N+j), v2y = _mm_loadu_ps(avy+N+j), v2z = _mm_loadu_ps(avz+N+j);
+        __m128 dv = _mm_add_ps(_mm_mul_ps(ex,_mm_sub_ps(v1x,v2x)),_mm_add_ps(_mm_mul_ps(ey,_mm_sub_ps(v1y,v2y)),_mm_mul_ps(ez,_mm_sub_ps(v1z,v2z))));
+        __m128 f = _mm_sub_ps(_mm_mul_ps(vks,_mm_sub_ps(l,vl0)),_mm_mul_ps(vkd,dv));
+        __m128 fx = _mm_mul_ps(f,ex), fy = _mm_mul_ps(f,ey), fz = _mm_mul_ps(f,ez);
+        _mm_storeu_ps(avx+j, _mm_add_ps(v1x,fx));
+        _mm_storeu_ps(avy+j, _mm_add_ps(v1y,fy));
+        _mm_storeu_ps(avz+j, _mm_add_ps(v1z,fz));
+        _mm_storeu_ps(avx+N+j, _mm_sub_ps(v2x,fx));
+        _mm_storeu_ps(avy+N+j, _mm_sub_ps(v2y,fy));
+        _mm_storeu_ps(avz+N+j, _mm_sub_ps(v2z,fz));
+    }
+    for (; j < N; j++){
+        int k = cloth.index(i,j);
+        applySpring(cloth, k, k+N, ks, kd);
+    }
+}
+
+static inline void splitEvenOddSse(const float* p, __m128& even, __m128& odd){
+    __m128 a = _mm_loadu_ps(p), b = _mm_loadu_ps(p+4);
+    even = _mm_shuffle_ps(a,b,_MM_SHUFFLE(2,0,2,0));
+    odd = _mm_shuffle_ps(a,b,_MM_SHUFFLE(3,1,3,1));
+}
+
+static inline void mergeEvenOddSse(float* p, __m128 even, __m128 odd){
+    _mm_storeu_ps(p, _mm_unpacklo_ps(even, odd));
+    _mm_storeu_ps(p+4, _mm_unpackhi_ps(even, odd));
+}
+
+static void pairedSpringsSse(Cloth& cloth, int first, int pairs, float ks, float kd){
+    float *px = cloth.pos.x+first, *py = cloth.pos.y+first, *pz = cloth.pos.z+first;
+    float *vx = cloth.vel.x+first, *vy = cloth.vel.y+first, *vz = cloth.vel.z+first;
+    __m128 vks = _mm_set1_ps(ks), vkd = _mm_set1_ps(kd);
+    __m128 vl0 = _mm_set1_ps(cloth.l0), one = _mm_set1_ps(1.0f);
+    int t = 0;
+    for (; t + 4 <= pairs; t += 4){
+        int j = 2*t;
+        __m128 ax, ay, az, bx, by, bz, avx, avy, avz, bvx, bvy, bvz;
+        splitEvenOddSse(px+j, ax, bx); splitEvenOddSse(py+j, ay, by); splitEvenOddSse(pz+j, az, bz);
+        splitEvenOddSse(vx+j, avx, bvx); splitEvenOddSse(vy+j, avy, bvy); splitEvenOddSse(vz+j, avz, bvz);
+        __m128 ex = _mm_sub_ps(bx,ax), ey = _mm_sub_ps(by,ay), ez = _mm_sub_ps(bz,az);
+        __m128 l = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(ex,ex),_mm_add_ps(_mm_mul_ps(ey,ey),_mm_mul_ps(ez,ez))));
+        __m128 inv = _mm_div_ps(one, l);
+        ex = _mm_mul_ps(ex,inv); ey = _mm_mul_ps(ey,inv); ez = _mm_mul_ps(ez,inv);
+        __m128 dv = _mm_add_ps(_mm_mul_ps(ex,_mm_sub_ps(avx,bvx)),_mm_add_ps(_mm_mul_ps(ey,_mm_sub_ps(avy,bvy)),_mm_mul_ps(ez,_mm_sub_ps(avz,bvz))));
+        __m128 f = _mm_sub_ps(_mm_mul_ps(vks,_mm_sub_ps(l,vl0)),_mm_mul_ps(vkd,dv));
+        __m128 fx = _mm_mul_ps(f,ex), fy = _mm_mul_ps(f,ey), fz = _mm_mul_ps(f,ez);
+        mergeEvenOddSse(vx+j, _mm_add_ps(avx,fx), _mm_sub_ps(bvx,fx));
+        mergeEvenOddSse(vy+j, _mm_add_ps(avy,fy), _mm_sub_ps(bvy,fy));
+        mergeEvenOddSse(vz+j, _mm_add_ps(avz,fz), _mm_sub_ps(bvz,fz));
+    }
+    for (; t < pairs; t++){
+        applySpring(cloth, first+2*t, first+2*t+1, ks, kd);
+    }
+}
+
+static void horizontalSpringsSse(Cloth& cloth, int i, float ks, float kd){
+    int N = cloth.n;
+    pairedSpringsSse(cloth, cloth.index(i,0), N/2, ks, kd);
+    pairedSpringsSse(cloth, cloth.index(i,1), (N-1)/2, ks, kd);
+}
+
+static void aeroSse(Cloth& cloth, int i, float scale, float drag){
+    int N = cloth.n;
+    const float *px = cloth.pos.x+i*N, *py = cloth.pos.y+i*N, *pz = cloth.pos.z+i*N;
+    const float *vx = cloth.vel.x+i*N, *vy = cloth.vel.y+i*N, *vz = cloth.vel.z+i*N;
+    int f = cloth.face(i,0);
+    float *nx = cloth.faceNormal.x+f, *ny = cloth.faceNormal.y+f, *nz = cloth.faceNormal.z+f;
+    float *ax = cloth.faceAero.x+f, *ay = cloth.faceAero.y+f, *az = cloth.faceAero.z+f;
+    __m128 vscale = _mm_set1_ps(scale), vdrag = _mm_set1_ps(drag);
+    __m128 quarter = _mm_set1_ps(.25f), one = _mm_set1_ps(1.0f), zero = _mm_setzero_ps();
+    int j = 0;
+    for (; j + 4 <= N-1; j += 4){
+        __m128 d1x = _mm_sub_ps(_mm_loadu_ps(px+j+1), _mm_loadu_ps(px+N+j));
+        __m128 d1y = _mm_sub_ps(_mm_loadu_ps(py+j+1), _mm_loadu_ps(py+N+j));
+        __m128 d1z = _mm_sub_ps(_mm_loadu_ps(pz+j+1), _mm_loadu_ps(pz+N+j));
+        __m128 d2x = _mm_sub_ps(_mm_loadu_ps(px+N+j+1), _mm_loadu_ps(px+j));
+        __m128 d2y = _mm_sub_ps(_mm_loadu_ps(py+N+j+1), _mm_loadu_ps(py+j));
+        __m128 d2z = _mm_sub_ps(_mm_loadu_ps(pz+N+j+1), _mm_loadu_ps(pz+j));
+        __m128 cx = _mm_sub_ps(_mm_mul_ps(d1y,d2z),_mm_mul_ps(d1z,d2y));
+        __m128 cy = _mm_sub_ps(_mm_mul_ps(d1z,d2x),_mm_mul_ps(d1x,d2z));
+        __m128 cz = _mm_sub_ps(_mm_mul_ps(d1x,d2y),_mm_mul_ps(d1y,d2x));
+        __m128 ux = _mm_mul_ps(quarter, _mm_add_ps(_mm_add_ps(_mm_loadu_ps(vx+j), _mm_loadu_ps(vx+j+1)), _mm_add_ps(_mm_loadu_ps(vx+N+j), _mm_loadu_ps(vx+N+j+1))));
+        __m128 uy = _mm_mul_ps(quarter, _mm_add_ps(_mm_add_ps(_mm_loadu_ps(vy+j), _mm_loadu_ps(vy+j+1)), _mm_add_ps(_mm_loadu_ps(vy+N+j), _mm_loadu_ps(vy+N+j+1))));
+        __m128 uz = _mm_mul_ps(quarter, _mm_add_ps(_mm_add_ps(_mm_loadu_ps(vz+j), _mm_loadu_ps(vz+j+1)), _mm_add_ps(_mm_loadu_ps(vz+N+j), _mm_loadu_ps(vz+N+j+1))));
+        __m128 vv = _mm_add_ps(_mm_mul_ps(ux,ux),_mm_add_ps(_mm_mul_ps(uy,uy),_mm_mul_ps(uz,uz)));
+        __m128 nn = _mm_add_ps(_mm_mul_ps(cx,cx),_mm_add_ps(_mm_mul_ps(cy,cy),_mm_mul_ps(cz,cz)));
+        __m128 vn = _mm_add_ps(_mm_mul_ps(ux,cx),_mm_add_ps(_mm_mul_ps(uy,cy),_mm_mul_ps(uz,cz)));
+        __m128 live = _mm_cmpgt_ps(nn, zero);
+        __m128 a = _mm_mul_ps(_mm_mul_ps(vscale, _mm_sqrt_ps(_mm_div_ps(vv,nn))), vn);
+        a = _mm_and_ps(live, _mm_div_ps(a, _mm_add_ps(one, _mm_mul_ps(vdrag, _mm_sqrt_ps(_mm_mul_ps(vv,nn))))));
+        _mm_storeu_ps(nx+j, cx); _mm_storeu_ps(ny+j, cy); _mm_storeu_ps(nz+j, cz);
+        _mm_storeu_ps(ax+j, _mm_mul_ps(a,cx)); _mm_storeu_ps(ay+j, _mm_mul_ps(a,cy)); _mm_storeu_ps(az+j, _mm_mul_ps(a,cz));
+    }
+    for (; j < N-1; j++) aeroQuad(cloth, i, j, scale, drag);
+}
+
+static void normalsSse(Cloth& cloth, int i){
+    int N = cloth.n;
+    int above = i > 0 ? (i-1)*N : i*N, below = i < N-1 ? (i+1)*N : i*N;
+    const float *px = cloth.pos.x+i*N, *py = cloth.pos.y+i*N, *pz = cloth.pos.z+i*N;
+    float *nx = cloth.norm.x+i*N, *ny = cloth.norm.y+i*N, *nz = cloth.norm.z+i*N;
+    __m128 one = _mm_set1_ps(1.0f);
+    vertexNormal(cloth, i, 0);
+    int j = 1;
+    for (; j + 4 <= N-1; j += 4){
+        __m128 ux = _mm_sub_ps(_mm_loadu_ps(px+j+1), _mm_loadu_ps(px+j-1));
+        __m128 uy = _mm_sub_ps(_mm_loadu_ps(py+j+1), _mm_loadu_ps(py+j-1));
+        __m128 uz = _mm_sub_ps(_mm_loadu_ps(pz+j+1), _mm_loadu_ps(pz+j-1));
+        __m128 vx = _mm_sub_ps(_mm_loadu_ps(cloth.pos.x+below+j), _mm_loadu_ps(cloth.pos.x+above+j));
+        __m128 vy = _mm_sub_ps(_mm_loadu_ps(cloth.pos.y+below+j), _mm_loadu_ps(cloth.pos.y+above+j));
+        __m128 vz = _mm_sub_ps(_mm_loadu_ps(cloth.pos.z+below+j), _mm_loadu_ps(cloth.pos.z+above+j));
+        __m128 cx = _mm_sub_ps(_mm_mul_ps(uy,vz),_mm_mul_ps(uz,vy));
+        __m128 cy = _mm_sub_ps(_mm_mul_ps(uz,vx),_mm_mul_ps(ux,vz));
+        __m128 cz = _mm_sub_ps(_mm_mul_ps(ux,vy),_mm_mul_ps(uy,vx));
+        __m128 inv = _mm_div_ps(one, _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(cx,cx),_mm_add_ps(_mm_mul_ps(cy,cy),_mm_mul_ps(cz,cz)))));
+        _mm_storeu_ps(nx+j, _mm_mul_ps(cx,inv));
+        _mm_storeu_ps(ny+j, _mm_mul_ps(cy,inv));
+        _mm_storeu_ps(nz+j, _mm_mul_ps(cz,inv));
+    }
+    for (; j < N; j++) vertexNormal(cloth, i, j);
+}
+#endif
+
+//Pick the widest kernel the CPU supports, or the one named on the command line
+void selectSpringKernels(const char* name){
+    springKernels.name = "scalar";
+    springKernels.vertical = verticalSpringsScalar;
+    springKernels.horizontal = horizontalSpringsScalar;
+    springKernels.aero = aeroScalar;
+    springKernels.normals = normalsScalar;
+#if defined(__x86_64__)
+    string want = name ? name : "";
+    if (want == "scalar") return;
+    if ((want == "" || want == "avx2") && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")){
+        springKernels.name = "avx2";
+        springKernels.vertical = verticalSpringsAvx2;
+        springKernels.horizontal = horizontalSpringsAvx2;
+        springKernels.aero = aeroAvx2;
+        springKernels.normals = normalsAvx2;
+    }
+    else if (want == "" || want == "sse" || want == "avx2"){
+        springKernels.name = "sse";
+        springKernels.vertical = verticalSpringsSse;
+        springKernels.horizontal = horizontalSpringsSse;
+        springKernels.aero = aeroSse;
+        springKernels.normals = normalsSse;
+    }
+#endif
+}
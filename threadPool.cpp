@@ -0,0 +1,91 @@
+#include "threadPool.h"
+using namespace std;
+
+ThreadPool::ThreadPool(int threads){
+    job = NULL;
+    jobBegin = 0; jobEnd = 0;
+    generation = 0; pending = 0;
+    running = false;
+    quit = false;
+    for (int id = 1; id < threads; id++){
+        workers.push_back(thread(&ThreadPool::workerLoop, this, id));
+    }
+}
+
+ThreadPool::~ThreadPool(){
+    {
+        lock_guard<mutex> guard(lock);
+        quit = true;
+    }
+    wake.notify_all();
+    for (size_t t = 0; t < workers.size(); t++){
+        workers[t].join();
+    }
+}
+
+//Run body(lo,hi) on contiguous shares of [begin,end), returns once every share is done
+void ThreadPool::parallelFor(int begin, int end, const function<void(int,int)>& body){
+    if (workers.empty() || end - begin < 2){
+        if (begin < end) body(begin, end);
+        return;
+    }
+    bool nested;
+    {
+        lock_guard<mutex> guard(lock);
+        //the workers are taken, waiting for them from inside their own job would never return
+        nested = running;
+        if (!nested){
+            running = true;
+            job = &body;
+            jobBegin = begin; jobEnd = end;
+            pending = (int)workers.size();
+            generation++;
+        }
+    }
+    if (nested){
+        body(begin, end);
+        return;
+    }
+    wake.notify_all();
+    try{
+        runShare(0);
+    }
+    catch (...){
+        //the workers still run body, it has to outlive them
+        waitForWorkers();
+        throw;
+    }
+    waitForWorkers();
+}
+
+void ThreadPool::waitForWorkers(){
+    unique_lock<mutex> guard(lock);
+    while (pending > 0){
+        finished.wait(guard);
+    }
+    running = false;
+}
+
+void ThreadPool::runShare(int id){
+    long count = jobEnd - jobBegin;
+    int lo = jobBegin + (int)(count*id/size());
+    int hi = jobBegin + (int)(count*(id+1)/size());
+    if (lo < hi) (*job)(lo, hi);
+}
+
+void ThreadPool::workerLoop(int id){
+    int seen = 0;
+    while (true){
+        {
+            unique_lock<mutex> guard(lock);
+            while (!quit && generation == seen){
+                wake.wait(guard);
+            }
+            if (quit) return;
+            seen = generation;
+        }
+        runShare(id);
+        lock_guard<mutex> guard(lock);
+        if (--pending == 0) finished.notify_one();
+    }
+}
@@ -0,0 +1,33 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <vector>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+//Worker threads that split a range of rows between them, the calling thread takes the first share.
+//A parallelFor started while another one is running (from inside its body, or from a second
+//thread) runs its body on the calling thread instead.
+class ThreadPool{
+public:
+    ThreadPool(int threads);
+    ~ThreadPool();
+    int size() const { return (int)workers.size() + 1; }
+    void parallelFor(int begin, int end, const std::function<void(int,int)>& body);
+private:
+    void workerLoop(int id);
+    void runShare(int id);
+    void waitForWorkers();
+    std::vector<std::thread> workers;
+    std::mutex lock;
+    std::condition_variable wake, finished;
+    const std::function<void(int,int)>* job;
+    int jobBegin, jobEnd;
+    int generation, pending;
+    bool running;
+    bool quit;
+};
+
+#endif
@@ -0,0 +1,101 @@
+#include "xpbdSolver.h"
+#include "collision.h"
+#include "selfCollision.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+using namespace std;
+
+XpbdSolver::XpbdSolver(int _n){
+    n = _n;
+    prevPos.allocate(n*n);
+    invMass = allocateFloats(n*n);
+    vertLambda = allocateFloats(n*n);
+    horizLambda = allocateFloats(n*n);
+}
+
+XpbdSolver::~XpbdSolver(){
+    prevPos.release();
+    free(invMass);
+    free(vertLambda);
+    free(horizLambda);
+}
+
+//Project the distance constraint between a and b, alpha is compliance/dt^2
+static void projectConstraint(Cloth& cloth, float* invMass, float& lambda, int a, int b, float alpha){
+    float w = invMass[a] + invMass[b];
+    if (w == 0.0f){
+        return;
+    }
+    glm::vec3 d = cloth.pos.get(a) - cloth.pos.get(b);
+    float l = sqrt(dot(d,d));
+    if (l == 0.0f){
+        return;
+    }
+    float c = l - cloth.l0;
+    float dLambda = (-c - alpha*lambda) / (w + alpha);
+    lambda += dLambda;
+    glm::vec3 correction = (dLambda/l)*d;
+    cloth.pos.add(a, invMass[a]*correction);
+    cloth.pos.sub(b, invMass[b]*correction);
+}
+
+void XpbdSolver::solve(Cloth& cloth, const SimParams& params, float dt){
+    int N = n;
+    //particles on the floor and the pinned row are left alone by updateRow, so they do not move here either
+    forEachRow(0, N, 1, [&](int i){
+        for (int k = cloth.index(i,0); k < cloth.index(i+1,0); k++){
+            bool fixed = (i == 0 && !params.drop) || cloth.pos.y[k] - (-2.0) < .02f;
+            invMass[k] = fixed ? 0.0f : 1.0f;
+            prevPos.set(k, cloth.pos.get(k));
+        }
+    });
+    memset(vertLambda, 0, N*N*sizeof(float));
+    memset(horizLambda, 0, N*N*sizeof(float));
+
+    //predict with gravity, wind and aero, the sphere and floor collisions and the pinned row
+    integratePositions(cloth, params, dt);
+
+    float compliance = params.compliance >= 0.0f ? params.compliance : 1.0f/params.ks;
+    float alpha = compliance/(dt*dt);
+    for (int iteration = 0; iteration < params.solverIterations; iteration++){
+        //vertical, even rows then odd rows so no two threads move the same particle
+        for (int color = 0; color < 2; color++){
+            forEachRow(color, N-1, 2, [&](int i){
+                for (int k = cloth.index(i,0); k < cloth.index(i+1,0); k++){
+                    projectConstraint(cloth, invMass, vertLambda[k], k, k+N, alpha);
+                }
+            });
+        }
+        //horizontal, constraints in different rows never share a particle
+        forEachRow(0, N, 1, [&](int i){
+            for (int k = cloth.index(i,0); k < cloth.index(i+1,0)-1; k++){
+                projectConstraint(cloth, invMass, horizLambda[k], k, k+1, alpha);
+            }
+        });
+    }
+
+    //velocity from the corrected positions, then keep the result out of the sphere and floor
+    forEachRow(0, N, 1, [&](int i){
+        for (int k = cloth.index(i,0); k < cloth.index(i+1,0); k++){
+            if (invMass[k] == 0.0f){
+                continue;
+            }
+            cloth.vel.set(k, (cloth.pos.get(k) - prevPos.get(k))*(1.0f/dt));
+            collideSphere(cloth, params, k);
+            if (cloth.pos.y[k] < -2.0f){
+                cloth.pos.y[k] = -2.0f;
+            }
+        }
+    });
+    collideObstacles(cloth, params, dt);
+    collideSelf(cloth, params, NULL);
+}
+
+void xpbdUpdate(Cloth& cloth, const SimParams& params, float dt){
+    if (cloth.xpbdSolver == NULL){
+        cloth.xpbdSolver = new XpbdSolver(cloth.n);
+    }
+    cloth.xpbdSolver->solve(cloth, params, dt);
+}
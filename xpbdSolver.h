@@ -0,0 +1,23 @@
+#ifndef XPBDSOLVER_H
+#define XPBDSOLVER_H
+
+#include "clothSim.h"
+
+//Extended position based dynamics. Each structural spring is a distance constraint with
+//compliance (inverse stiffness), projected a fixed number of times per step so the cost
+//does not grow with ks or dt.
+class XpbdSolver{
+public:
+    XpbdSolver(int n);
+    ~XpbdSolver();
+    void solve(Cloth& cloth, const SimParams& params, float dt);
+    int n;
+    Vec3Array prevPos;
+    //0 for particles the collision pass keeps in place, 1 otherwise
+    float* invMass;
+    //Accumulated constraint multipliers, vertical constraint k joins k and k+n, horizontal k joins k and k+1
+    float* vertLambda;
+    float* horizLambda;
+};
+
+#endif